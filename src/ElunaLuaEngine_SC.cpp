@@ -17,6 +17,7 @@
 
 #include "Chat.h"
 #include "ElunaEventMgr.h"
+#include "ElunaWriteBehind.h"
 #include "Log.h"
 #include "LuaEngine.h"
 #include "Pet.h"
@@ -32,7 +33,7 @@ public:
     // Creature
     bool CanCreatureGossipHello(Player* player, Creature* creature) override
     {
-        if (sEluna->OnGossipHello(player, creature))
+        if (Eluna::GetStateFor(creature)->OnGossipHello(player, creature))
             return true;
 
         return false;
@@ -40,7 +41,7 @@ public:
 
     bool CanCreatureGossipSelect(Player* player, Creature* creature, uint32 sender, uint32 action) override
     {
-        if (sEluna->OnGossipSelect(player, creature, sender, action))
+        if (Eluna::GetStateFor(creature)->OnGossipSelect(player, creature, sender, action))
             return true;
 
         return false;
@@ -48,7 +49,7 @@ public:
 
     bool CanCreatureGossipSelectCode(Player* player, Creature* creature, uint32 sender, uint32 action, const char* code) override
     {
-        if (sEluna->OnGossipSelectCode(player, creature, sender, action, code))
+        if (Eluna::GetStateFor(creature)->OnGossipSelectCode(player, creature, sender, action, code))
             return true;
 
         return false;
@@ -56,8 +57,9 @@ public:
 
     void OnCreatureAddWorld(Creature* creature) override
     {
-        sEluna->OnAddToWorld(creature);
-        sEluna->OnAllCreatureAddToWorld(creature);
+        Eluna* E = Eluna::GetStateFor(creature);
+        E->OnAddToWorld(creature);
+        E->OnAllCreatureAddToWorld(creature);
 
         if (creature->IsGuardian() && creature->ToTempSummon() && creature->ToTempSummon()->GetSummonerGUID().IsPlayer())
             sEluna->OnPetAddedToWorld(creature->ToTempSummon()->GetSummonerUnit()->ToPlayer(), creature);
@@ -65,20 +67,21 @@ public:
 
     void OnCreatureRemoveWorld(Creature* creature) override
     {
-        sEluna->OnRemoveFromWorld(creature);
-        sEluna->OnAllCreatureRemoveFromWorld(creature);
+        Eluna* E = Eluna::GetStateFor(creature);
+        E->OnRemoveFromWorld(creature);
+        E->OnAllCreatureRemoveFromWorld(creature);
     }
 
     bool CanCreatureQuestAccept(Player* player, Creature* creature, Quest const* quest) override
     {
         sEluna->OnPlayerQuestAccept(player, quest);
-        sEluna->OnQuestAccept(player, creature, quest);
+        Eluna::GetStateFor(creature)->OnQuestAccept(player, creature, quest);
         return false;
     }
 
     bool CanCreatureQuestReward(Player* player, Creature* creature, Quest const* quest, uint32 opt) override
     {
-        if (sEluna->OnQuestReward(player, creature, quest, opt))
+        if (Eluna::GetStateFor(creature)->OnQuestReward(player, creature, quest, opt))
         {
             ClearGossipMenuFor(player);
             return true;
@@ -89,7 +92,7 @@ public:
 
     CreatureAI* GetCreatureAI(Creature* creature) const override
     {
-        if (CreatureAI* luaAI = sEluna->GetAI(creature))
+        if (CreatureAI* luaAI = Eluna::GetStateFor(creature)->GetAI(creature))
             return luaAI;
 
         return nullptr;
@@ -97,12 +100,12 @@ public:
 
     void OnCreatureSelectLevel(const CreatureTemplate* cinfo, Creature* creature) override
     {
-        sEluna->OnAllCreatureSelectLevel(cinfo, creature);
+        Eluna::GetStateFor(creature)->OnAllCreatureSelectLevel(cinfo, creature);
     }
 
     void OnBeforeCreatureSelectLevel(const CreatureTemplate* cinfo, Creature* creature, uint8& level) override
     {
-        sEluna->OnAllCreatureBeforeSelectLevel(cinfo, creature, level);
+        Eluna::GetStateFor(creature)->OnAllCreatureBeforeSelectLevel(cinfo, creature, level);
     }
 };
 
@@ -113,25 +116,26 @@ public:
 
     void OnGameObjectAddWorld(GameObject* go) override
     {
-        sEluna->OnAddToWorld(go);
+        Eluna::GetStateFor(go)->OnAddToWorld(go);
     }
 
     void OnGameObjectRemoveWorld(GameObject* go) override
     {
-        sEluna->OnRemoveFromWorld(go);
+        Eluna::GetStateFor(go)->OnRemoveFromWorld(go);
     }
 
     void OnGameObjectUpdate(GameObject* go, uint32 diff) override
     {
-        sEluna->UpdateAI(go, diff);
+        Eluna::GetStateFor(go)->UpdateAI(go, diff);
     }
 
     bool CanGameObjectGossipHello(Player* player, GameObject* go) override
     {
-        if (sEluna->OnGossipHello(player, go))
+        Eluna* E = Eluna::GetStateFor(go);
+        if (E->OnGossipHello(player, go))
             return true;
 
-        if (sEluna->OnGameObjectUse(player, go))
+        if (E->OnGameObjectUse(player, go))
             return true;
 
         return false;
@@ -139,34 +143,34 @@ public:
 
     void OnGameObjectDamaged(GameObject* go, Player* player) override
     {
-        sEluna->OnDamaged(go, player);
+        Eluna::GetStateFor(go)->OnDamaged(go, player);
     }
 
     void OnGameObjectDestroyed(GameObject* go, Player* player) override
     {
-        sEluna->OnDestroyed(go, player);
+        Eluna::GetStateFor(go)->OnDestroyed(go, player);
     }
 
     void OnGameObjectLootStateChanged(GameObject* go, uint32 state, Unit* /*unit*/) override
     {
-        sEluna->OnLootStateChanged(go, state);
+        Eluna::GetStateFor(go)->OnLootStateChanged(go, state);
     }
 
     void OnGameObjectStateChanged(GameObject* go, uint32 state) override
     {
-        sEluna->OnGameObjectStateChanged(go, state);
+        Eluna::GetStateFor(go)->OnGameObjectStateChanged(go, state);
     }
 
     bool CanGameObjectQuestAccept(Player* player, GameObject* go, Quest const* quest) override
     {
         sEluna->OnPlayerQuestAccept(player, quest);
-        sEluna->OnQuestAccept(player, go, quest);
+        Eluna::GetStateFor(go)->OnQuestAccept(player, go, quest);
         return false;
     }
 
     bool CanGameObjectGossipSelect(Player* player, GameObject* go, uint32 sender, uint32 action) override
     {
-        if (sEluna->OnGossipSelect(player, go, sender, action))
+        if (Eluna::GetStateFor(go)->OnGossipSelect(player, go, sender, action))
             return true;
 
         return false;
@@ -174,7 +178,7 @@ public:
 
     bool CanGameObjectGossipSelectCode(Player* player, GameObject* go, uint32 sender, uint32 action, const char* code) override
     {
-        if (sEluna->OnGossipSelectCode(player, go, sender, action, code))
+        if (Eluna::GetStateFor(go)->OnGossipSelectCode(player, go, sender, action, code))
             return true;
 
         return false;
@@ -182,13 +186,14 @@ public:
 
     bool CanGameObjectQuestReward(Player* player, GameObject* go, Quest const* quest, uint32 opt) override
     {
-        if (sEluna->OnQuestAccept(player, go, quest))
+        Eluna* E = Eluna::GetStateFor(go);
+        if (E->OnQuestAccept(player, go, quest))
         {
             sEluna->OnPlayerQuestAccept(player, quest);
             return false;
         }
 
-        if (sEluna->OnQuestReward(player, go, quest, opt))
+        if (E->OnQuestReward(player, go, quest, opt))
             return true;
 
         return false;
@@ -196,7 +201,7 @@ public:
 
     GameObjectAI* GetGameObjectAI(GameObject* go) const override
     {
-        sEluna->OnSpawn(go);
+        Eluna::GetStateFor(go)->OnSpawn(go);
         return nullptr;
     }
 };
@@ -268,37 +273,40 @@ public:
     void OnBeforeCreateInstanceScript(InstanceMap* instanceMap, InstanceScript** instanceData, bool /*load*/, std::string /*data*/, uint32 /*completedEncounterMask*/) override
     {
         if (instanceData)
-            *instanceData = sEluna->GetInstanceData(instanceMap);
+            *instanceData = Eluna::GetMapState(instanceMap)->GetInstanceData(instanceMap);
     }
 
     void OnDestroyInstance(MapInstanced* /*mapInstanced*/, Map* map) override
     {
-        sEluna->FreeInstanceId(map->GetInstanceId());
+        if (Eluna* E = Eluna::FindMapState(map))
+            E->FreeInstanceId(map->GetInstanceId());
     }
 
     void OnCreateMap(Map* map) override
     {
-        sEluna->OnCreate(map);
+        Eluna::GetMapState(map)->OnCreate(map);
     }
 
     void OnDestroyMap(Map* map) override
     {
-        sEluna->OnDestroy(map);
+        if (Eluna* E = Eluna::FindMapState(map))
+            E->OnDestroy(map);
+        Eluna::DestroyMapState(map);
     }
 
     void OnPlayerEnterAll(Map* map, Player* player) override
     {
-        sEluna->OnPlayerEnter(map, player);
+        Eluna::GetMapState(map)->OnPlayerEnter(map, player);
     }
 
     void OnPlayerLeaveAll(Map* map, Player* player) override
     {
-        sEluna->OnPlayerLeave(map, player);
+        Eluna::GetMapState(map)->OnPlayerLeave(map, player);
     }
 
     void OnMapUpdate(Map* map, uint32 diff) override
     {
-        sEluna->OnUpdate(map, diff);
+        Eluna::GetMapState(map)->OnUpdate(map, diff);
     }
 };
 
@@ -562,9 +570,9 @@ public:
     void GetDialogStatus(Player* player, Object* questgiver) override
     {
         if (questgiver->GetTypeId() == TYPEID_GAMEOBJECT)
-            sEluna->GetDialogStatus(player, questgiver->ToGameObject());
+            Eluna::GetStateFor(questgiver->ToGameObject())->GetDialogStatus(player, questgiver->ToGameObject());
         else if (questgiver->GetTypeId() == TYPEID_UNIT)
-            sEluna->GetDialogStatus(player, questgiver->ToCreature());
+            Eluna::GetStateFor(questgiver->ToCreature())->GetDialogStatus(player, questgiver->ToCreature());
     }
 };
 
@@ -834,6 +842,7 @@ public:
     void OnPlayerLogout(Player* player) override
     {
         sEluna->OnLogout(player);
+        ElunaWriteBehindMgr::GetInstance().RequestFlushAll();
     }
 
     void OnPlayerCreate(Player* player) override
@@ -1001,12 +1010,12 @@ public:
 
     void OnDummyEffect(WorldObject* caster, uint32 spellID, SpellEffIndex effIndex, GameObject* gameObjTarget) override
     {
-        sEluna->OnDummyEffect(caster, spellID, effIndex, gameObjTarget);
+        Eluna::GetStateFor(gameObjTarget)->OnDummyEffect(caster, spellID, effIndex, gameObjTarget);
     }
 
     void OnDummyEffect(WorldObject* caster, uint32 spellID, SpellEffIndex effIndex, Creature* creatureTarget) override
     {
-        sEluna->OnDummyEffect(caster, spellID, effIndex, creatureTarget);
+        Eluna::GetStateFor(creatureTarget)->OnDummyEffect(caster, spellID, effIndex, creatureTarget);
     }
 
     void OnDummyEffect(WorldObject* caster, uint32 spellID, SpellEffIndex effIndex, Item* itemTarget) override
@@ -1084,13 +1093,22 @@ public:
 
     void OnWorldObjectSetMap(WorldObject* object, Map* /*map*/) override
     {
+        // The processor is created by the first RegisterEvent call on the object
         if (!object->elunaEvents)
-            object->elunaEvents = new ElunaEventProcessor(&Eluna::GEluna, object);
+            return;
+
+        // With multistate an object moving to another map also moves to that map's state
+        if (object->elunaEvents->GetOwner() != Eluna::GetStateFor(object))
+        {
+            delete object->elunaEvents;
+            object->elunaEvents = nullptr;
+        }
     }
 
     void OnWorldObjectUpdate(WorldObject* object, uint32 diff) override
     {
-        object->elunaEvents->Update(diff);
+        if (object->elunaEvents)
+            object->elunaEvents->Update(diff);
     }
 };
 
@@ -1146,6 +1164,7 @@ public:
     void OnUpdate(uint32 diff) override
     {
         sEluna->OnWorldUpdate(diff);
+        ElunaWriteBehindMgr::GetInstance().Update(diff);
     }
 
     void OnStartup() override
@@ -1156,6 +1175,7 @@ public:
     void OnShutdown() override
     {
         sEluna->OnShutdown();
+        ElunaWriteBehindMgr::GetInstance().FlushAllAndWait();
     }
 
     void OnAfterUnloadAllMaps() override
@@ -1166,7 +1186,7 @@ public:
     void OnBeforeWorldInitialized() override
     {
         ///- Run eluna scripts.
-        // in multithread foreach: run scripts
+        // Map states run their scripts when they are created
         sEluna->RunScripts();
         sEluna->OnConfigLoad(false, false); // Must be done after Eluna is initialized and scripts have run.
     }
@@ -1216,7 +1236,7 @@ public:
             sEluna->OnPlayerAuraApply(unit->ToPlayer(), aura);
 
         if (unit->IsCreature())
-            sEluna->OnCreatureAuraApply(unit->ToCreature(), aura);
+            Eluna::GetStateFor(unit)->OnCreatureAuraApply(unit->ToCreature(), aura);
     }
 
     void OnHeal(Unit* healer, Unit* receiver, uint32& gain) override
@@ -1227,7 +1247,7 @@ public:
             sEluna->OnPlayerHeal(healer->ToPlayer(), receiver, gain);
 
         if (healer->IsCreature())
-            sEluna->OnCreatureHeal(healer->ToCreature(), receiver, gain);
+            Eluna::GetStateFor(healer)->OnCreatureHeal(healer->ToCreature(), receiver, gain);
     }
 
     void OnDamage(Unit* attacker, Unit* receiver, uint32& damage) override
@@ -1238,7 +1258,7 @@ public:
             sEluna->OnPlayerDamage(attacker->ToPlayer(), receiver, damage);
 
         if (attacker->IsCreature())
-            sEluna->OnCreatureDamage(attacker->ToCreature(), receiver, damage);
+            Eluna::GetStateFor(attacker)->OnCreatureDamage(attacker->ToCreature(), receiver, damage);
     }
 };
 
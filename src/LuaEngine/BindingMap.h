@@ -8,6 +8,7 @@
 #define _BINDING_MAP_H
 
 #include <memory>
+#include <atomic>
 #include "Common.h"
 #include "ElunaUtility.h"
 #include <type_traits>
@@ -19,57 +20,386 @@ extern "C"
 };
 
 
+/*
+ * Tracks which event IDs (and roughly which keys) have bindings so hooks
+ *   can bail out without taking the binding map lock.
+ *
+ * Writes happen with the binding map locked, reads are single relaxed loads.
+ * A set event bit means there is at least one binding for that event ID.
+ * A zero key slot means there is no binding for any key hashing to it,
+ *   a non-zero slot has to be confirmed with a real lookup.
+ */
+class BindingPresence
+{
+public:
+    static const uint32 MAX_EVENT_ID = 128;
+    static const uint32 KEY_SLOTS = 1024;
+
+    BindingPresence()
+    {
+        Reset();
+    }
+
+    bool HasEvent(uint32 event_id) const
+    {
+        if (event_id >= MAX_EVENT_ID)
+            return false;
+        return (eventBits[event_id / 64].load(std::memory_order_relaxed) & (uint64(1) << (event_id % 64))) != 0;
+    }
+
+    bool MayHaveKey(std::size_t hash) const
+    {
+        return keySlots[hash & (KEY_SLOTS - 1)].load(std::memory_order_relaxed) != 0;
+    }
+
+    void Add(uint32 event_id, std::size_t hash, uint32 count = 1)
+    {
+        ASSERT(event_id < MAX_EVENT_ID);
+        if (!eventCounts[event_id])
+            eventBits[event_id / 64].fetch_or(uint64(1) << (event_id % 64), std::memory_order_relaxed);
+        eventCounts[event_id] += count;
+        keySlots[hash & (KEY_SLOTS - 1)].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void Remove(uint32 event_id, std::size_t hash, uint32 count = 1)
+    {
+        ASSERT(event_id < MAX_EVENT_ID && eventCounts[event_id] >= count);
+        eventCounts[event_id] -= count;
+        if (!eventCounts[event_id])
+            eventBits[event_id / 64].fetch_and(~(uint64(1) << (event_id % 64)), std::memory_order_relaxed);
+        keySlots[hash & (KEY_SLOTS - 1)].fetch_sub(count, std::memory_order_relaxed);
+    }
+
+    void Reset()
+    {
+        for (uint32 i = 0; i < MAX_EVENT_ID / 64; ++i)
+            eventBits[i].store(0, std::memory_order_relaxed);
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+            eventCounts[i] = 0;
+        for (uint32 i = 0; i < KEY_SLOTS; ++i)
+            keySlots[i].store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64> eventBits[MAX_EVENT_ID / 64];
+    // Only touched with the binding map locked
+    uint32 eventCounts[MAX_EVENT_ID];
+    std::atomic<uint32> keySlots[KEY_SLOTS];
+};
+
 /*
  * A set of bindings from keys of type `K` to Lua references.
+ *
+ * Bindings are indexed in two levels: first directly by event ID, then by
+ *   the rest of the key in a small open addressing table per event.
  */
 template<typename K>
 class BindingMap : public ElunaUtil::Lockable
 {
 private:
-    lua_State* L;
-    uint64 maxBindingID;
+    static const uint32 MAX_EVENT_ID = BindingPresence::MAX_EVENT_ID;
+    // How many bindings of a key are stored without allocating
+    static const uint32 INLINE_BINDINGS = 2;
 
     struct Binding
     {
+        // Binding IDs start from 1, 0 marks a removed binding
         uint64 id;
-        lua_State* L;
         uint32 remainingShots;
         int functionReference;
+    };
 
-        Binding(lua_State* L, uint64 id, int functionReference, uint32 remainingShots) :
-            id(id),
-            L(L),
-            remainingShots(remainingShots),
-            functionReference(functionReference)
+    /*
+     * The bindings of a single key, in registration order.
+     *
+     * Removed bindings are left in place as tombstones, so the positions
+     *   kept in `id_lookup_table` stay valid until the list is compacted.
+     */
+    class BindingList
+    {
+    public:
+        BindingList() :
+            count(0),
+            live(0)
         { }
 
-        ~Binding()
+        uint32 Size() const { return count; }
+        uint32 Live() const { return live; }
+        bool HasTombstones() const { return live != count; }
+
+        Binding& operator[](uint32 index)
+        {
+            return index < INLINE_BINDINGS ? inlineBindings[index] : overflow[index - INLINE_BINDINGS];
+        }
+
+        uint32 Add(uint64 id, int ref, uint32 shots)
         {
-            luaL_unref(L, LUA_REGISTRYINDEX, functionReference);
+            Binding binding = { id, shots, ref };
+            if (count < INLINE_BINDINGS)
+                inlineBindings[count] = binding;
+            else
+                overflow.push_back(binding);
+
+            ++live;
+            return count++;
         }
+
+        void Kill(uint32 index)
+        {
+            (*this)[index].id = 0;
+            --live;
+        }
+
+        /*
+         * Drop the tombstones, calling `moved(id, index)` for every
+         *   binding that got a new position.
+         */
+        template<typename F>
+        void Compact(F moved)
+        {
+            uint32 kept = 0;
+            for (uint32 i = 0; i < count; ++i)
+            {
+                Binding binding = (*this)[i];
+                if (!binding.id)
+                    continue;
+
+                if (kept != i)
+                {
+                    (*this)[kept] = binding;
+                    moved(binding.id, kept);
+                }
+                ++kept;
+            }
+
+            count = kept;
+            overflow.resize(count > INLINE_BINDINGS ? count - INLINE_BINDINGS : 0);
+        }
+
+    private:
+        Binding inlineBindings[INLINE_BINDINGS];
+        std::vector<Binding> overflow;
+        uint32 count;
+        uint32 live;
     };
 
-    typedef std::vector< std::unique_ptr<Binding> > BindingList;
+    struct Entry
+    {
+        K key;
+        std::size_t hash;
+        BindingList list;
+
+        Entry(const K& key, std::size_t hash) :
+            key(key),
+            hash(hash)
+        { }
+    };
 
-    std::unordered_map<K, BindingList> bindings;
     /*
-     * This table is for fast removal of bindings by ID.
+     * An open addressing hash table from the keys of one event ID to their bindings.
      *
-     * Instead of having to look through (potentially) every BindingList to find
-     *   the Binding with the right ID, this allows you to go directly to the
-     *   BindingList that might have the Binding with that ID.
+     * The slots only hold part of the hash and an index into the densely
+     *   stored entries, so a probe touches very little memory. Erasing leaves
+     *   a tombstone in the slot, those are dropped when the table is rehashed.
+     */
+    class KeyTable
+    {
+    public:
+        KeyTable() :
+            deleted(0)
+        { }
+
+        bool Empty() const { return entries.empty(); }
+        std::size_t Count() const { return entries.size(); }
+        Entry& At(std::size_t index) { return entries[index]; }
+
+        Entry* Find(const K& key, std::size_t hash)
+        {
+            uint32 slot = FindSlot(key, hash);
+            if (slot == NO_SLOT)
+                return NULL;
+            return &entries[slots[slot].entry];
+        }
+
+        Entry& FindOrInsert(const K& key, std::size_t hash)
+        {
+            if (Entry* entry = Find(key, hash))
+                return *entry;
+
+            if ((entries.size() + deleted + 1) * 4 > slots.size() * 3)
+                Rehash();
+
+            uint32 mask = uint32(slots.size() - 1);
+            uint32 i = uint32(hash) & mask;
+            while (slots[i].entry != SLOT_EMPTY && slots[i].entry != SLOT_DELETED)
+                i = (i + 1) & mask;
+
+            if (slots[i].entry == SLOT_DELETED)
+                --deleted;
+
+            slots[i].hash = uint32(hash);
+            slots[i].entry = uint32(entries.size());
+            entries.push_back(Entry(key, hash));
+            return entries.back();
+        }
+
+        void Erase(const K& key, std::size_t hash)
+        {
+            uint32 slot = FindSlot(key, hash);
+            if (slot == NO_SLOT)
+                return;
+
+            uint32 index = slots[slot].entry;
+            slots[slot].entry = SLOT_DELETED;
+            ++deleted;
+
+            // Keep the entries dense by moving the last one into the hole
+            uint32 last = uint32(entries.size() - 1);
+            if (index != last)
+            {
+                slots[FindSlot(entries[last].key, entries[last].hash)].entry = index;
+                entries[index] = std::move(entries[last]);
+            }
+            entries.pop_back();
+        }
+
+        void Clear()
+        {
+            slots.clear();
+            entries.clear();
+            deleted = 0;
+        }
+
+    private:
+        static const uint32 SLOT_EMPTY = 0xFFFFFFFF;
+        static const uint32 SLOT_DELETED = 0xFFFFFFFE;
+        static const uint32 NO_SLOT = 0xFFFFFFFF;
+        static const uint32 MIN_SLOTS = 16;
+
+        struct Slot
+        {
+            uint32 hash;
+            uint32 entry;
+        };
+
+        std::vector<Slot> slots;
+        std::vector<Entry> entries;
+        uint32 deleted;
+
+        uint32 FindSlot(const K& key, std::size_t hash) const
+        {
+            if (slots.empty())
+                return NO_SLOT;
+
+            uint32 mask = uint32(slots.size() - 1);
+            for (uint32 i = uint32(hash) & mask;; i = (i + 1) & mask)
+            {
+                const Slot& slot = slots[i];
+                if (slot.entry == SLOT_EMPTY)
+                    return NO_SLOT;
+
+                if (slot.entry != SLOT_DELETED && slot.hash == uint32(hash) && std::equal_to<K>()(entries[slot.entry].key, key))
+                    return i;
+            }
+        }
+
+        void Rehash()
+        {
+            std::size_t size = MIN_SLOTS;
+            while ((entries.size() + 1) * 2 > size)
+                size *= 2;
+
+            slots.assign(size, Slot{ 0, SLOT_EMPTY });
+            deleted = 0;
+
+            uint32 mask = uint32(size - 1);
+            for (uint32 index = 0; index < entries.size(); ++index)
+            {
+                uint32 i = uint32(entries[index].hash) & mask;
+                while (slots[i].entry != SLOT_EMPTY)
+                    i = (i + 1) & mask;
+
+                slots[i].hash = uint32(entries[index].hash);
+                slots[i].entry = index;
+            }
+        }
+    };
+
+    struct BindingLocation
+    {
+        K key;
+        uint32 index;
+
+        BindingLocation(const K& key, uint32 index) :
+            key(key),
+            index(index)
+        { }
+    };
+
+    lua_State* L;
+    uint64 maxBindingID;
+    BindingPresence presence;
+    // Bumped on every change to the bindings, see `GetGeneration`
+    std::atomic<uint32> generation;
+    // Shared by all maps of this key type, so a recreated map never reuses a generation
+    static std::atomic<uint32> lastGeneration;
+
+    KeyTable tables[MAX_EVENT_ID];
+    /*
+     * This table is for fast removal of bindings by ID.
      *
-     * However, you must be careful not to store pointers to BindingLists
-     *   that no longer exist (see `void Clear(const K& key)` implementation).
+     * It stores the key of every binding and its position in the key's
+     *   BindingList, so the binding can be turned into a tombstone directly.
+     *   Positions are updated whenever a BindingList is compacted.
      */
-    std::unordered_map<uint64, BindingList*> id_lookup_table;
+    std::unordered_map<uint64, BindingLocation> id_lookup_table;
+
+    static std::size_t HashKey(const K& key)
+    {
+        return std::hash<K>()(key);
+    }
+
+    void Changed()
+    {
+        generation.store(++lastGeneration, std::memory_order_release);
+    }
+
+    void Compact(BindingList& list)
+    {
+        list.Compact([this](uint64 id, uint32 index)
+        {
+            auto iter = id_lookup_table.find(id);
+            if (iter != id_lookup_table.end())
+                iter->second.index = index;
+        });
+    }
+
+    void UnrefAll(BindingList& list)
+    {
+        for (uint32 i = 0; i < list.Size(); ++i)
+        {
+            Binding& binding = list[i];
+            if (!binding.id)
+                continue;
+
+            luaL_unref(L, LUA_REGISTRYINDEX, binding.functionReference);
+        }
+    }
 
 public:
     BindingMap(lua_State* L) :
         L(L),
-        maxBindingID(0)
+        maxBindingID(0),
+        generation(++lastGeneration)
     { }
 
+    ~BindingMap()
+    {
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+            for (std::size_t j = 0; j < tables[i].Count(); ++j)
+                UnrefAll(tables[i].At(j).list);
+    }
+
     /*
      * Insert a new binding from `key` to `ref`, which lasts for `shots`-many pushes.
      *
@@ -80,10 +410,15 @@ public:
     {
         Guard guard(GetLock());
 
+        ASSERT(uint32(key.event_id) < MAX_EVENT_ID);
+
         uint64 id = (++maxBindingID);
-        BindingList& list = bindings[key];
-        list.push_back(std::unique_ptr<Binding>(new Binding(L, id, ref, shots)));
-        id_lookup_table[id] = &list;
+        std::size_t hash = HashKey(key);
+        Entry& entry = tables[key.event_id].FindOrInsert(key, hash);
+        uint32 index = entry.list.Add(id, ref, shots);
+        id_lookup_table.emplace(id, BindingLocation(key, index));
+        presence.Add(key.event_id, hash);
+        Changed();
         return id;
     }
 
@@ -94,23 +429,24 @@ public:
     {
         Guard guard(GetLock());
 
-        if (bindings.empty())
+        if (id_lookup_table.empty() || uint32(key.event_id) >= MAX_EVENT_ID)
             return;
 
-        auto iter = bindings.find(key);
-        if (iter == bindings.end())
+        KeyTable& table = tables[key.event_id];
+        std::size_t hash = HashKey(key);
+        Entry* entry = table.Find(key, hash);
+        if (!entry)
             return;
 
-        BindingList& list = iter->second;
-
-        // Remove all pointers to `list` from `id_lookup_table`.
-        for (auto i = list.begin(); i != list.end(); ++i)
-        {
-            std::unique_ptr<Binding>& binding = *i;
-            id_lookup_table.erase(binding->id);
-        }
+        BindingList& list = entry->list;
+        for (uint32 i = 0; i < list.Size(); ++i)
+            if (list[i].id)
+                id_lookup_table.erase(list[i].id);
 
-        bindings.erase(key);
+        UnrefAll(list);
+        presence.Remove(key.event_id, hash, list.Live());
+        table.Erase(key, hash);
+        Changed();
     }
 
     /*
@@ -120,11 +456,29 @@ public:
     {
         Guard guard(GetLock());
 
-        if (bindings.empty())
+        if (id_lookup_table.empty())
             return;
 
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+        {
+            KeyTable& table = tables[i];
+            for (std::size_t j = 0; j < table.Count(); ++j)
+                UnrefAll(table.At(j).list);
+            table.Clear();
+        }
+
         id_lookup_table.clear();
-        bindings.clear();
+        presence.Reset();
+        Changed();
+    }
+
+    /*
+     * Returns `true` if the binding identified by `id` was not removed yet.
+     */
+    bool Contains(uint64 id)
+    {
+        Guard guard(GetLock());
+        return id_lookup_table.find(id) != id_lookup_table.end();
     }
 
     /*
@@ -140,22 +494,42 @@ public:
         if (iter == id_lookup_table.end())
             return;
 
-        BindingList* list = iter->second;
-        auto i = list->begin();
+        const K key = iter->second.key;
+        uint32 index = iter->second.index;
+        id_lookup_table.erase(iter);
 
-        for (; i != list->end(); ++i)
-        {
-            std::unique_ptr<Binding>& binding = *i;
-            if (binding->id == id)
-                break;
-        }
+        KeyTable& table = tables[key.event_id];
+        std::size_t hash = HashKey(key);
+        Entry* entry = table.Find(key, hash);
+        if (!entry)
+            return;
+
+        BindingList& list = entry->list;
+        if (index >= list.Size() || list[index].id != id)
+            return;
+
+        Binding& binding = list[index];
 
-        if (i != list->end())
-            list->erase(i);
+        luaL_unref(L, LUA_REGISTRYINDEX, binding.functionReference);
+        list.Kill(index);
+        presence.Remove(key.event_id, hash);
+        Changed();
 
-        // Unconditionally erase the ID in the lookup table because
-        //   it was either already invalid, or it's no longer valid.
-        id_lookup_table.erase(id);
+        if (!list.Live())
+            table.Erase(key, hash);
+        else if (list.Size() - list.Live() > list.Live())
+            Compact(list);
+    }
+
+    /*
+     * Get a counter that changes whenever a binding is added or removed.
+     *
+     * Lets callers cache the result of `HasBindingsFor` and only redo the
+     *   lookups when the bindings have changed since.
+     */
+    uint32 GetGeneration() const
+    {
+        return generation.load(std::memory_order_acquire);
     }
 
     /*
@@ -163,17 +537,18 @@ public:
      */
     bool HasBindingsFor(const K& key)
     {
-        Guard guard(GetLock());
-
-        if (bindings.empty())
+        // Most hooks have nothing bound, answer those without locking
+        if (!presence.HasEvent(key.event_id))
             return false;
 
-        auto result = bindings.find(key);
-        if (result == bindings.end())
+        std::size_t hash = HashKey(key);
+        if (!presence.MayHaveKey(hash))
             return false;
 
-        BindingList& list = result->second;
-        return !list.empty();
+        Guard guard(GetLock());
+
+        // Entries are erased as soon as their last binding is gone
+        return tables[key.event_id].Find(key, hash) != NULL;
     }
 
     /*
@@ -183,35 +558,283 @@ public:
     {
         Guard guard(GetLock());
 
-        if (bindings.empty())
+        if (id_lookup_table.empty() || uint32(key.event_id) >= MAX_EVENT_ID)
             return;
 
-        auto result = bindings.find(key);
-        if (result == bindings.end())
+        KeyTable& table = tables[key.event_id];
+        std::size_t hash = HashKey(key);
+        Entry* entry = table.Find(key, hash);
+        if (!entry)
             return;
 
-        BindingList& list = result->second;
-        for (auto i = list.begin(); i != list.end();)
+        BindingList& list = entry->list;
+        for (uint32 i = 0; i < list.Size(); ++i)
         {
-            std::unique_ptr<Binding>& binding = (*i);
-            auto i_prev = (i++);
+            Binding& binding = list[i];
+            if (!binding.id)
+                continue;
 
-            lua_rawgeti(L, LUA_REGISTRYINDEX, binding->functionReference);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, binding.functionReference);
 
-            if (binding->remainingShots > 0)
+            if (binding.remainingShots > 0 && --binding.remainingShots == 0)
             {
-                binding->remainingShots -= 1;
-
-                if (binding->remainingShots == 0)
-                {
-                    id_lookup_table.erase(binding->id);
-                    list.erase(i_prev);
-                }
+                // The function is already on the stack, so the reference can go
+                luaL_unref(L, LUA_REGISTRYINDEX, binding.functionReference);
+                id_lookup_table.erase(binding.id);
+                list.Kill(i);
+                presence.Remove(key.event_id, hash);
             }
         }
+
+        if (!list.HasTombstones())
+            return;
+
+        Changed();
+        if (!list.Live())
+            table.Erase(key, hash);
+        else
+            Compact(list);
     }
 };
 
+template<typename K>
+std::atomic<uint32> BindingMap<K>::lastGeneration(0);
+
+template <typename T> struct EventKey;
+
+/*
+ * Bindings for simple event ID keys.
+ *
+ * Event IDs are small enum values, so instead of hashing they index a fixed
+ *   array directly. Each event keeps its bindings as parallel arrays of
+ *   function references, remaining shots and IDs, so pushing the references
+ *   is a linear walk over contiguous memory.
+ */
+template<typename T>
+class BindingMap< EventKey<T> > : public ElunaUtil::Lockable
+{
+private:
+    static const uint32 MAX_EVENT_ID = BindingPresence::MAX_EVENT_ID;
+
+    struct BindingList
+    {
+        std::vector<int> functionReferences;
+        std::vector<uint32> remainingShots;
+        std::vector<uint64> ids;
+
+        bool empty() const { return ids.empty(); }
+        std::size_t size() const { return ids.size(); }
+
+        void erase(std::size_t index)
+        {
+            functionReferences.erase(functionReferences.begin() + index);
+            remainingShots.erase(remainingShots.begin() + index);
+            ids.erase(ids.begin() + index);
+        }
+    };
+
+    lua_State* L;
+    uint64 maxBindingID;
+
+    BindingList bindings[MAX_EVENT_ID];
+    // Binding count of each event, readable without locking
+    std::atomic<uint32> counts[MAX_EVENT_ID];
+    // Binding ID -> event ID, for `Remove`
+    std::unordered_map<uint64, uint32> id_lookup_table;
+
+    void ClearEvent(uint32 event_id)
+    {
+        BindingList& list = bindings[event_id];
+        for (std::size_t i = 0; i < list.size(); ++i)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, list.functionReferences[i]);
+            id_lookup_table.erase(list.ids[i]);
+        }
+
+        list.functionReferences.clear();
+        list.remainingShots.clear();
+        list.ids.clear();
+        counts[event_id].store(0, std::memory_order_relaxed);
+    }
+
+public:
+    BindingMap(lua_State* L) :
+        L(L),
+        maxBindingID(0)
+    {
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+            counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    ~BindingMap()
+    {
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+            for (std::size_t j = 0; j < bindings[i].size(); ++j)
+                luaL_unref(L, LUA_REGISTRYINDEX, bindings[i].functionReferences[j]);
+    }
+
+    /*
+     * Insert a new binding from `key` to `ref`, which lasts for `shots`-many pushes.
+     *
+     * If `shots` is 0, it will never automatically expire, but can still be
+     *   removed with `Clear` or `Remove`.
+     */
+    uint64 Insert(const EventKey<T>& key, int ref, uint32 shots)
+    {
+        Guard guard(GetLock());
+
+        uint32 event_id = key.event_id;
+        ASSERT(event_id < MAX_EVENT_ID);
+
+        uint64 id = (++maxBindingID);
+        BindingList& list = bindings[event_id];
+        list.functionReferences.push_back(ref);
+        list.remainingShots.push_back(shots);
+        list.ids.push_back(id);
+        id_lookup_table[id] = event_id;
+        counts[event_id].store(uint32(list.size()), std::memory_order_relaxed);
+        return id;
+    }
+
+    /*
+     * Clear all bindings for `key`.
+     */
+    void Clear(const EventKey<T>& key)
+    {
+        Guard guard(GetLock());
+
+        uint32 event_id = key.event_id;
+        if (event_id >= MAX_EVENT_ID)
+            return;
+
+        ClearEvent(event_id);
+    }
+
+    /*
+     * Clear all bindings for all keys.
+     */
+    void Clear()
+    {
+        Guard guard(GetLock());
+
+        if (id_lookup_table.empty())
+            return;
+
+        for (uint32 i = 0; i < MAX_EVENT_ID; ++i)
+            if (!bindings[i].empty())
+                ClearEvent(i);
+    }
+
+    /*
+     * Returns `true` if the binding identified by `id` was not removed yet.
+     */
+    bool Contains(uint64 id)
+    {
+        Guard guard(GetLock());
+        return id_lookup_table.find(id) != id_lookup_table.end();
+    }
+
+    /*
+     * Remove a specific binding identified by `id`.
+     *
+     * If `id` in invalid, nothing is removed.
+     */
+    void Remove(uint64 id)
+    {
+        Guard guard(GetLock());
+
+        auto iter = id_lookup_table.find(id);
+        if (iter == id_lookup_table.end())
+            return;
+
+        uint32 event_id = iter->second;
+        BindingList& list = bindings[event_id];
+        for (std::size_t i = 0; i < list.size(); ++i)
+        {
+            if (list.ids[i] != id)
+                continue;
+
+            luaL_unref(L, LUA_REGISTRYINDEX, list.functionReferences[i]);
+            list.erase(i);
+            counts[event_id].store(uint32(list.size()), std::memory_order_relaxed);
+            break;
+        }
+
+        id_lookup_table.erase(iter);
+    }
+
+    /*
+     * Check whether `key` has any bindings.
+     */
+    bool HasBindingsFor(const EventKey<T>& key)
+    {
+        uint32 event_id = key.event_id;
+        if (event_id >= MAX_EVENT_ID)
+            return false;
+
+        return counts[event_id].load(std::memory_order_relaxed) != 0;
+    }
+
+    /*
+     * Push all Lua references for `key` onto the stack.
+     */
+    void PushRefsFor(const EventKey<T>& key)
+    {
+        Guard guard(GetLock());
+
+        uint32 event_id = key.event_id;
+        if (event_id >= MAX_EVENT_ID)
+            return;
+
+        BindingList& list = bindings[event_id];
+        std::size_t count = list.size();
+        if (!count)
+            return;
+
+        const int* refs = list.functionReferences.data();
+        uint32* shots = list.remainingShots.data();
+        uint64* ids = list.ids.data();
+        bool expired = false;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, refs[i]);
+
+            if (shots[i] > 0 && --shots[i] == 0)
+            {
+                // Binding IDs start from 1, 0 marks the binding as expired
+                id_lookup_table.erase(ids[i]);
+                ids[i] = 0;
+                expired = true;
+            }
+        }
+
+        if (!expired)
+            return;
+
+        // Compact the lists in place, keeping the registration order.
+        // The references of expired bindings are released, they are already on the stack.
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (!ids[i])
+            {
+                luaL_unref(L, LUA_REGISTRYINDEX, refs[i]);
+                continue;
+            }
+
+            list.functionReferences[kept] = list.functionReferences[i];
+            list.remainingShots[kept] = list.remainingShots[i];
+            list.ids[kept] = list.ids[i];
+            ++kept;
+        }
+
+        list.functionReferences.resize(kept);
+        list.remainingShots.resize(kept);
+        list.ids.resize(kept);
+        counts[event_id].store(uint32(kept), std::memory_order_relaxed);
+    }
+};
 
 /*
  * A `BindingMap` key type for simple event ID bindings
@@ -0,0 +1,229 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaBytecodeCache.h"
+#include "ElunaUtility.h"
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#if AC_PLATFORM != AC_PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ELUNA_MMAP_CACHE
+#endif
+
+extern "C"
+{
+#include "lua.h"
+};
+
+namespace
+{
+    const char BLOB_MAGIC[8] = { 'E', 'L', 'U', 'N', 'A', 'B', 'C', '2' };
+    // lua_dump is always called without stripping debug information
+    const uint8 BLOB_STRIP = 0;
+
+    struct BlobHeader
+    {
+        char magic[8];
+        uint64 build;           // Hash of the Lua release the bytecode is for
+        uint32 luaVersion;      // LUA_VERSION_NUM
+        uint8 strip;
+        uint8 pointerSize;
+        uint8 numberSize;
+        uint8 padding;
+        uint64 sourceHash;
+        uint64 sourceSize;
+        uint64 pathSize;        // The script path follows the header, then the bytecode
+        uint64 bytecodeSize;
+    };
+
+    uint64 Fnv1a(const char* data, size_t size, uint64 hash = 14695981039346656037ULL)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= uint8(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    uint64 GetBuildHash()
+    {
+        std::string build = LUA_RELEASE;
+#ifdef LUAJIT_VERSION
+        build += LUAJIT_VERSION;
+#endif
+        return Fnv1a(build.data(), build.size());
+    }
+
+    BlobHeader MakeHeader(uint64 hash, size_t sourceSize, size_t pathSize, size_t bytecodeSize)
+    {
+        BlobHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, BLOB_MAGIC, sizeof(BLOB_MAGIC));
+        header.build = GetBuildHash();
+        header.luaVersion = LUA_VERSION_NUM;
+        header.strip = BLOB_STRIP;
+        header.pointerSize = uint8(sizeof(void*));
+        header.numberSize = uint8(sizeof(lua_Number));
+        header.sourceHash = hash;
+        header.sourceSize = sourceSize;
+        header.pathSize = pathSize;
+        header.bytecodeSize = bytecodeSize;
+        return header;
+    }
+}
+
+std::string ElunaBytecodeCache::directory;
+
+ElunaBytecodeBlob::~ElunaBytecodeBlob()
+{
+#ifdef ELUNA_MMAP_CACHE
+    if (mapping)
+        munmap(mapping, mappingSize);
+#endif
+}
+
+void ElunaBytecodeCache::SetDirectory(const std::string& path)
+{
+    directory.clear();
+    if (path.empty())
+        return;
+
+    try
+    {
+        boost::filesystem::create_directories(path);
+    }
+    catch (const std::exception& e)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Could not create bytecode cache directory `{}`: {}", path, e.what());
+        return;
+    }
+
+    directory = path;
+    ELUNA_LOG_INFO("[Eluna]: Using bytecode cache directory `{}`", directory);
+}
+
+uint64 ElunaBytecodeCache::HashSource(const std::string& scriptPath, const std::string& source, SourceType type)
+{
+    // The same text compiles differently as Lua and as MoonScript, and under another chunk name
+    char kind = char(type);
+    uint64 hash = Fnv1a(scriptPath.data(), scriptPath.size(), Fnv1a(&kind, 1));
+    return Fnv1a(source.data(), source.size(), Fnv1a("", 1, hash));
+}
+
+std::string ElunaBytecodeCache::GetBlobPath(uint64 hash)
+{
+    return fmt::format("{}/{:016x}.luac", directory, hash);
+}
+
+std::shared_ptr<ElunaBytecodeBlob> ElunaBytecodeCache::Load(const std::string& scriptPath, uint64 hash, size_t sourceSize)
+{
+    if (!IsEnabled())
+        return NULL;
+
+    std::string path = GetBlobPath(hash);
+    BlobHeader expected = MakeHeader(hash, sourceSize, scriptPath.size(), 0);
+    std::shared_ptr<ElunaBytecodeBlob> blob(new ElunaBytecodeBlob());
+
+#ifdef ELUNA_MMAP_CACHE
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || size_t(fileInfo.st_size) < sizeof(BlobHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t fileSize = size_t(fileInfo.st_size);
+    void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    blob->mapping = mapping;
+    blob->mappingSize = fileSize;
+    const char* file = static_cast<const char*>(mapping);
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream.is_open())
+        return NULL;
+
+    size_t fileSize = size_t(stream.tellg());
+    if (fileSize < sizeof(BlobHeader))
+        return NULL;
+
+    blob->buffer.resize(fileSize);
+    stream.seekg(0, std::ios::beg);
+    if (!stream.read(blob->buffer.data(), fileSize))
+        return NULL;
+
+    const char* file = blob->buffer.data();
+#endif
+
+    // Only the header is checked, the bytecode itself is verified by Lua when loading it
+    BlobHeader header;
+    memcpy(&header, file, sizeof(header));
+    expected.bytecodeSize = header.bytecodeSize;
+    if (memcmp(&header, &expected, sizeof(header)) != 0 || fileSize - sizeof(header) != header.pathSize + header.bytecodeSize ||
+        memcmp(file + sizeof(header), scriptPath.data(), scriptPath.size()) != 0)
+    {
+        ELUNA_LOG_DEBUG("[Eluna]: Ignoring stale bytecode cache blob `{}`", path);
+        return NULL;
+    }
+
+    blob->data = file + sizeof(header) + header.pathSize;
+    blob->size = size_t(header.bytecodeSize);
+    return blob;
+}
+
+bool ElunaBytecodeCache::Store(const std::string& scriptPath, uint64 hash, size_t sourceSize, const uint8* bytecode, size_t bytecodeSize)
+{
+    if (!IsEnabled())
+        return false;
+
+    std::string path = GetBlobPath(hash);
+    // Written under a temporary name and renamed, so other readers never see a partial blob
+    std::string tempPath = fmt::format("{}.{}.tmp", path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    BlobHeader header = MakeHeader(hash, sourceSize, scriptPath.size(), bytecodeSize);
+    {
+        std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open())
+            return false;
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(scriptPath.data(), scriptPath.size());
+        stream.write(reinterpret_cast<const char*>(bytecode), bytecodeSize);
+        if (!stream)
+        {
+            stream.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    try
+    {
+        boost::filesystem::rename(tempPath, path);
+    }
+    catch (const std::exception& e)
+    {
+        ELUNA_LOG_DEBUG("[Eluna]: Could not write bytecode cache blob `{}`: {}", path, e.what());
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_BYTECODE_CACHE_H
+#define _ELUNA_BYTECODE_CACHE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Common.h"
+
+/*
+ * A compiled script loaded from the disk cache.
+ *
+ * The file is mapped into memory where possible, so only the pages Lua
+ *   reads while loading the chunk are touched. It is unmapped once the last
+ *   reference to the blob is gone.
+ */
+class ElunaBytecodeBlob
+{
+public:
+    ~ElunaBytecodeBlob();
+
+    const char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    friend class ElunaBytecodeCache;
+
+    ElunaBytecodeBlob() : mapping(NULL), mappingSize(0), data(NULL), size(0) { }
+
+    void* mapping;
+    size_t mappingSize;
+    // Holds the file on platforms without mapping support
+    std::vector<char> buffer;
+    const char* data;
+    size_t size;
+};
+
+/*
+ * Bytecode cache directory shared by all worldserver runs.
+ *
+ * Blobs are named after a hash of the script path and source. Each starts with a
+ *   header recording the Lua build, the strip flag and the source it was compiled
+ *   from, followed by the script path, all checked before the bytecode is handed
+ *   to Lua. The bytecode keeps the chunk name of the script it was compiled
+ *   from, so a blob is never shared between scripts with the same content.
+ */
+class ElunaBytecodeCache
+{
+public:
+    enum SourceType
+    {
+        SOURCE_LUA          = 0,
+        SOURCE_MOONSCRIPT   = 1,
+    };
+
+    // Sets the cache directory and creates it, an empty path disables the cache
+    static void SetDirectory(const std::string& path);
+    static bool IsEnabled() { return !directory.empty(); }
+
+    static uint64 HashSource(const std::string& scriptPath, const std::string& source, SourceType type);
+
+    // Returns the cached bytecode for the script, or NULL when there is no valid blob
+    static std::shared_ptr<ElunaBytecodeBlob> Load(const std::string& scriptPath, uint64 hash, size_t sourceSize);
+    static bool Store(const std::string& scriptPath, uint64 hash, size_t sourceSize, const uint8* bytecode, size_t bytecodeSize);
+
+private:
+    static std::string GetBlobPath(uint64 hash);
+
+    static std::string directory;
+};
+
+#endif
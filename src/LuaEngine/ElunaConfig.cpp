@@ -21,10 +21,24 @@ void ElunaConfig::BuildConfigCache()
     SetConfigValue<bool>(ElunaConfigValues::TRACEBACK_ENABLED,          "Eluna.TraceBack",          "false");
     SetConfigValue<bool>(ElunaConfigValues::AUTORELOAD_ENABLED,         "Eluna.AutoReload",         "false");
     SetConfigValue<bool>(ElunaConfigValues::BYTECODE_CACHE_ENABLED,     "Eluna.BytecodeCache",      "false");
+    SetConfigValue<bool>(ElunaConfigValues::MULTISTATE_ENABLED,         "Eluna.MultiState",         "false");
+    SetConfigValue<bool>(ElunaConfigValues::ASYNC_RELOAD_ENABLED,       "Eluna.AsyncReload",        "false");
+    SetConfigValue<bool>(ElunaConfigValues::INCREMENTAL_RELOAD_ENABLED, "Eluna.IncrementalReload",  "false");
+    SetConfigValue<bool>(ElunaConfigValues::HTTP_CACHE_ENABLED,         "Eluna.HttpCache",          "false");
 
     SetConfigValue<std::string>(ElunaConfigValues::SCRIPT_PATH,         "Eluna.ScriptPath",         "lua_scripts");
     SetConfigValue<std::string>(ElunaConfigValues::REQUIRE_PATH,        "Eluna.RequirePaths",       "");
     SetConfigValue<std::string>(ElunaConfigValues::REQUIRE_CPATH,       "Eluna.RequireCPaths",      "");
+    SetConfigValue<std::string>(ElunaConfigValues::BYTECODE_CACHE_PATH, "Eluna.BytecodeCachePath",  "");
 
     SetConfigValue<uint32>(ElunaConfigValues::AUTORELOAD_INTERVAL,      "Eluna.AutoReloadInterval", 1);
+    SetConfigValue<uint32>(ElunaConfigValues::AUTORELOAD_DEBOUNCE,      "Eluna.AutoReloadDebounce", 500);
+    SetConfigValue<uint32>(ElunaConfigValues::HTTP_WORKERS,             "Eluna.HttpWorkers",        2);
+    SetConfigValue<uint32>(ElunaConfigValues::HTTP_QUEUE_SIZE,          "Eluna.HttpQueueSize",      256);
+    SetConfigValue<uint32>(ElunaConfigValues::HTTP_QUEUE_OVERFLOW,      "Eluna.HttpQueueOverflow",  0);
+    SetConfigValue<uint32>(ElunaConfigValues::HTTP_CACHE_TTL,           "Eluna.HttpCacheTTL",       60);
+    SetConfigValue<uint32>(ElunaConfigValues::UPDATE_BUDGET,            "Eluna.UpdateBudget",       0);
+    SetConfigValue<uint32>(ElunaConfigValues::WRITE_BEHIND_INTERVAL,    "Eluna.WriteBehindInterval", 1000);
+    SetConfigValue<uint32>(ElunaConfigValues::QUERY_CACHE_TTL,          "Eluna.QueryCacheTTL",      60);
+    SetConfigValue<uint32>(ElunaConfigValues::QUERY_CACHE_SIZE,         "Eluna.QueryCacheSize",     16384);
 }
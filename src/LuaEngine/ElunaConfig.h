@@ -10,14 +10,28 @@ enum class ElunaConfigValues : uint32
     TRACEBACK_ENABLED,
     AUTORELOAD_ENABLED,
     BYTECODE_CACHE_ENABLED,
+    MULTISTATE_ENABLED,
+    ASYNC_RELOAD_ENABLED,
+    INCREMENTAL_RELOAD_ENABLED,
+    HTTP_CACHE_ENABLED,
 
     // String
     SCRIPT_PATH,
     REQUIRE_PATH,
     REQUIRE_CPATH,
+    BYTECODE_CACHE_PATH,
 
     // Number
     AUTORELOAD_INTERVAL,
+    AUTORELOAD_DEBOUNCE,
+    HTTP_WORKERS,
+    HTTP_QUEUE_SIZE,
+    HTTP_QUEUE_OVERFLOW,
+    HTTP_CACHE_TTL,
+    UPDATE_BUDGET,
+    WRITE_BEHIND_INTERVAL,
+    QUERY_CACHE_TTL,
+    QUERY_CACHE_SIZE,
 
     CONFIG_VALUE_COUNT
 };
@@ -33,12 +47,26 @@ class ElunaConfig final : public ConfigValueCache<ElunaConfigValues>
         bool IsTraceBackEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::TRACEBACK_ENABLED); }
         bool IsAutoReloadEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::AUTORELOAD_ENABLED); }
         bool IsByteCodeCacheEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::BYTECODE_CACHE_ENABLED); }
+        bool IsMultiStateEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::MULTISTATE_ENABLED); }
+        bool IsAsyncReloadEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::ASYNC_RELOAD_ENABLED); }
+        bool IsIncrementalReloadEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::INCREMENTAL_RELOAD_ENABLED); }
+        bool IsHttpCacheEnabled() const { return GetConfigValue<bool>(ElunaConfigValues::HTTP_CACHE_ENABLED); }
 
         std::string_view GetScriptPath() const { return GetConfigValue(ElunaConfigValues::SCRIPT_PATH); }
         std::string_view GetRequirePath() const { return GetConfigValue(ElunaConfigValues::REQUIRE_PATH); }
         std::string_view GetRequireCPath() const { return GetConfigValue(ElunaConfigValues::REQUIRE_CPATH); }
+        std::string_view GetBytecodeCachePath() const { return GetConfigValue(ElunaConfigValues::BYTECODE_CACHE_PATH); }
 
         uint32 GetAutoReloadInterval() const { return GetConfigValue<uint32>(ElunaConfigValues::AUTORELOAD_INTERVAL); }
+        uint32 GetAutoReloadDebounce() const { return GetConfigValue<uint32>(ElunaConfigValues::AUTORELOAD_DEBOUNCE); }
+        uint32 GetHttpWorkers() const { return GetConfigValue<uint32>(ElunaConfigValues::HTTP_WORKERS); }
+        uint32 GetHttpQueueSize() const { return GetConfigValue<uint32>(ElunaConfigValues::HTTP_QUEUE_SIZE); }
+        uint32 GetHttpQueueOverflow() const { return GetConfigValue<uint32>(ElunaConfigValues::HTTP_QUEUE_OVERFLOW); }
+        uint32 GetHttpCacheTTL() const { return GetConfigValue<uint32>(ElunaConfigValues::HTTP_CACHE_TTL); }
+        uint32 GetUpdateBudget() const { return GetConfigValue<uint32>(ElunaConfigValues::UPDATE_BUDGET); }
+        uint32 GetWriteBehindInterval() const { return GetConfigValue<uint32>(ElunaConfigValues::WRITE_BEHIND_INTERVAL); }
+        uint32 GetQueryCacheTTL() const { return GetConfigValue<uint32>(ElunaConfigValues::QUERY_CACHE_TTL); }
+        uint32 GetQueryCacheSize() const { return GetConfigValue<uint32>(ElunaConfigValues::QUERY_CACHE_SIZE); }
 
     protected:
         void BuildConfigCache() override;
@@ -13,16 +13,40 @@ struct ScriptedAI;
 
 struct ElunaCreatureAI : ScriptedAI
 {
+    // the state that created the AI and handles its hooks
+    Eluna* E;
     // used to delay the spawn hook triggering on AI creation
     bool justSpawned;
     // used to delay movementinform hook (WP hook)
     std::vector< std::pair<uint32, uint32> > movepoints;
+    // events bound to this creature, refreshed when the bindings or the entry change
+    uint64 boundEvents;
+    uint32 boundGeneration;
+    uint32 boundEntry;
 
-    ElunaCreatureAI(Creature* creature) : ScriptedAI(creature), justSpawned(true)
+    ElunaCreatureAI(Eluna* _E, Creature* creature) : ScriptedAI(creature), E(_E), justSpawned(true)
     {
+        RefreshBoundEvents();
     }
     ~ElunaCreatureAI() { }
 
+    void RefreshBoundEvents()
+    {
+        // read the generation first so a concurrent change is picked up on the next check
+        boundGeneration = E->GetCreatureBindingGeneration();
+        boundEntry = me->GetEntry();
+        boundEvents = E->GetCreatureBindingMask(me);
+    }
+
+    // a bit test in the common case, the hooks are skipped entirely when nothing is bound
+    bool IsBound(Hooks::CreatureEvents event)
+    {
+        if (boundGeneration != E->GetCreatureBindingGeneration() || boundEntry != me->GetEntry())
+            RefreshBoundEvents();
+
+        return (boundEvents & (uint64(1) << event)) != 0;
+    }
+
     //Called at World update tick
     void UpdateAI(uint32 diff) override
     {
@@ -37,13 +61,13 @@ struct ElunaCreatureAI : ScriptedAI
         {
             for (auto& point : movepoints)
             {
-                if (!sEluna->MovementInform(me, point.first, point.second))
+                if (!IsBound(Hooks::CREATURE_EVENT_ON_REACH_WP) || !E->MovementInform(me, point.first, point.second))
                     ScriptedAI::MovementInform(point.first, point.second);
             }
             movepoints.clear();
         }
 
-        if (!sEluna->UpdateAI(me, diff))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_AIUPDATE) || !E->UpdateAI(me, diff))
         {
             if (!me->HasFlag(UNIT_FIELD_FLAGS, UNIT_FLAG_IMMUNE_TO_NPC))
                 ScriptedAI::UpdateAI(diff);
@@ -54,14 +78,14 @@ struct ElunaCreatureAI : ScriptedAI
     // Called at creature aggro either by MoveInLOS or Attack Start
     void JustEngagedWith(Unit* target) override
     {
-        if (!sEluna->EnterCombat(me, target))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_ENTER_COMBAT) || !E->EnterCombat(me, target))
             ScriptedAI::JustEngagedWith(target);
     }
 
     // Called at any Damage from any attacker (before damage apply)
     void DamageTaken(Unit* attacker, uint32& damage, DamageEffectType damagetype, SpellSchoolMask damageSchoolMask) override
     {
-        if (!sEluna->DamageTaken(me, attacker, damage))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_DAMAGE_TAKEN) || !E->DamageTaken(me, attacker, damage))
         {
             ScriptedAI::DamageTaken(attacker, damage, damagetype, damageSchoolMask);
         }
@@ -70,28 +94,28 @@ struct ElunaCreatureAI : ScriptedAI
     //Called at creature death
     void JustDied(Unit* killer) override
     {
-        if (!sEluna->JustDied(me, killer))
+        if ((!IsBound(Hooks::CREATURE_EVENT_ON_DIED) && !IsBound(Hooks::CREATURE_EVENT_ON_RESET)) || !E->JustDied(me, killer))
             ScriptedAI::JustDied(killer);
     }
 
     //Called at creature killing another unit
     void KilledUnit(Unit* victim) override
     {
-        if (!sEluna->KilledUnit(me, victim))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_TARGET_DIED) || !E->KilledUnit(me, victim))
             ScriptedAI::KilledUnit(victim);
     }
 
     // Called when the creature summon successfully other creature
     void JustSummoned(Creature* summon) override
     {
-        if (!sEluna->JustSummoned(me, summon))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_JUST_SUMMONED_CREATURE) || !E->JustSummoned(me, summon))
             ScriptedAI::JustSummoned(summon);
     }
 
     // Called when a summoned creature is despawned
     void SummonedCreatureDespawn(Creature* summon) override
     {
-        if (!sEluna->SummonedCreatureDespawn(me, summon))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_SUMMONED_CREATURE_DESPAWN) || !E->SummonedCreatureDespawn(me, summon))
             ScriptedAI::SummonedCreatureDespawn(summon);
     }
 
@@ -106,89 +130,89 @@ struct ElunaCreatureAI : ScriptedAI
     // Called before EnterCombat even before the creature is in combat.
     void AttackStart(Unit* target) override
     {
-        if (!sEluna->AttackStart(me, target))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_PRE_COMBAT) || !E->AttackStart(me, target))
             ScriptedAI::AttackStart(target);
     }
 
     // Called for reaction at stopping attack at no attackers or targets
     void EnterEvadeMode(EvadeReason /*why*/) override
     {
-        if (!sEluna->EnterEvadeMode(me))
+        if ((!IsBound(Hooks::CREATURE_EVENT_ON_LEAVE_COMBAT) && !IsBound(Hooks::CREATURE_EVENT_ON_RESET)) || !E->EnterEvadeMode(me))
             ScriptedAI::EnterEvadeMode();
     }
 
     // Called when creature is spawned or respawned (for reseting variables)
     void JustRespawned() override
     {
-        if (!sEluna->JustRespawned(me))
+        if ((!IsBound(Hooks::CREATURE_EVENT_ON_SPAWN) && !IsBound(Hooks::CREATURE_EVENT_ON_RESET)) || !E->JustRespawned(me))
             ScriptedAI::JustRespawned();
     }
 
     // Called at reaching home after evade
     void JustReachedHome() override
     {
-        if (!sEluna->JustReachedHome(me))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_REACH_HOME) || !E->JustReachedHome(me))
             ScriptedAI::JustReachedHome();
     }
 
     // Called at text emote receive from player
     void ReceiveEmote(Player* player, uint32 emoteId) override
     {
-        if (!sEluna->ReceiveEmote(me, player, emoteId))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_RECEIVE_EMOTE) || !E->ReceiveEmote(me, player, emoteId))
             ScriptedAI::ReceiveEmote(player, emoteId);
     }
 
     // called when the corpse of this creature gets removed
     void CorpseRemoved(uint32& respawnDelay) override
     {
-        if (!sEluna->CorpseRemoved(me, respawnDelay))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_CORPSE_REMOVED) || !E->CorpseRemoved(me, respawnDelay))
             ScriptedAI::CorpseRemoved(respawnDelay);
     }
 
     void MoveInLineOfSight(Unit* who) override
     {
-        if (!sEluna->MoveInLineOfSight(me, who))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_MOVE_IN_LOS) || !E->MoveInLineOfSight(me, who))
             ScriptedAI::MoveInLineOfSight(who);
     }
 
     // Called when hit by a spell
     void SpellHit(Unit* caster, SpellInfo const* spell) override
     {
-        if (!sEluna->SpellHit(me, caster, spell))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_HIT_BY_SPELL) || !E->SpellHit(me, caster, spell))
             ScriptedAI::SpellHit(caster, spell);
     }
 
     // Called when spell hits a target
     void SpellHitTarget(Unit* target, SpellInfo const* spell) override
     {
-        if (!sEluna->SpellHitTarget(me, target, spell))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_SPELL_HIT_TARGET) || !E->SpellHitTarget(me, target, spell))
             ScriptedAI::SpellHitTarget(target, spell);
     }
 
     // Called when the creature is summoned successfully by other creature
     void IsSummonedBy(WorldObject* summoner) override
     {
-        if (!summoner->ToUnit() || !sEluna->OnSummoned(me, summoner->ToUnit()))
+        if (!summoner->ToUnit() || !IsBound(Hooks::CREATURE_EVENT_ON_SUMMONED) || !E->OnSummoned(me, summoner->ToUnit()))
             ScriptedAI::IsSummonedBy(summoner);
     }
 
     void SummonedCreatureDies(Creature* summon, Unit* killer) override
     {
-        if (!sEluna->SummonedCreatureDies(me, summon, killer))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_SUMMONED_CREATURE_DIED) || !E->SummonedCreatureDies(me, summon, killer))
             ScriptedAI::SummonedCreatureDies(summon, killer);
     }
 
     // Called when owner takes damage
     void OwnerAttackedBy(Unit* attacker) override
     {
-        if (!sEluna->OwnerAttackedBy(me, attacker))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_OWNER_ATTACKED_AT) || !E->OwnerAttackedBy(me, attacker))
             ScriptedAI::OwnerAttackedBy(attacker);
     }
 
     // Called when owner attacks something
     void OwnerAttacked(Unit* target) override
     {
-        if (!sEluna->OwnerAttacked(me, target))
+        if (!IsBound(Hooks::CREATURE_EVENT_ON_OWNER_ATTACKED) || !E->OwnerAttacked(me, target))
             ScriptedAI::OwnerAttacked(target);
     }
 };
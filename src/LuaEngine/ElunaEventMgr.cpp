@@ -7,6 +7,7 @@
 #include "ElunaEventMgr.h"
 #include "LuaEngine.h"
 #include "Object.h"
+#include <limits>
 
 extern "C"
 {
@@ -14,64 +15,280 @@ extern "C"
 #include "lauxlib.h"
 };
 
-ElunaEventProcessor::ElunaEventProcessor(Eluna** _E, WorldObject* _obj) : m_time(0), obj(_obj), E(_E)
+LuaEventWheel::LuaEventWheel() : overflow(NULL), now(0), count(0)
 {
-    // can be called from multiple threads
-    if (obj)
+    for (uint32 level = 0; level < LEVELS; ++level)
     {
-        EventMgr::Guard guard((*E)->eventMgr->GetLock());
-        (*E)->eventMgr->processors.insert(this);
+        for (uint32 slot = 0; slot < SLOTS; ++slot)
+            slots[level][slot] = NULL;
+        occupied[level] = 0;
     }
 }
 
-ElunaEventProcessor::~ElunaEventProcessor()
+void LuaEventWheel::Link(LuaEvent*& tail, LuaEvent* luaEvent)
 {
-    // can be called from multiple threads
+    if (tail)
     {
-        LOCK_ELUNA;
-        RemoveEvents_internal();
+        luaEvent->next = tail->next;
+        tail->next = luaEvent;
     }
+    else
+        luaEvent->next = luaEvent;
+    tail = luaEvent;
+}
+
+LuaEvent* LuaEventWheel::Unlink(LuaEvent*& tail)
+{
+    if (!tail)
+        return NULL;
+
+    LuaEvent* head = tail->next;
+    tail->next = NULL;
+    tail = NULL;
+    return head;
+}
+
+int LuaEventWheel::NextSlot(uint32 level, uint32 from) const
+{
+    if (from >= SLOTS)
+        return -1;
+
+    uint64 bits = occupied[level] & (~uint64(0) << from);
+    if (!bits)
+        return -1;
 
-    if (obj && Eluna::IsInitialized())
+    int slot = 0;
+    while (!(bits & 0xFF))
     {
-        EventMgr::Guard guard((*E)->eventMgr->GetLock());
-        (*E)->eventMgr->processors.erase(this);
+        bits >>= 8;
+        slot += 8;
     }
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        ++slot;
+    }
+    return slot;
 }
 
-void ElunaEventProcessor::Update(uint32 diff)
+uint64 LuaEventWheel::NextCascadeTime() const
 {
-    m_time += diff;
-    for (EventList::iterator it = eventList.begin(); it != eventList.end() && it->first <= m_time; it = eventList.begin())
+    // The current slot of the levels above 0 is always empty, its events were already moved down
+    for (uint32 level = 1; level < LEVELS; ++level)
     {
-        LuaEvent* luaEvent = it->second;
-        eventList.erase(it);
+        uint32 shift = level * SLOT_BITS;
+        int slot = NextSlot(level, (uint32(now >> shift) & (SLOTS - 1)) + 1);
+        if (slot >= 0)
+            return ((now >> (shift + SLOT_BITS)) << (shift + SLOT_BITS)) + (uint64(slot) << shift);
+    }
 
-        if (luaEvent->state != LUAEVENT_STATE_ERASE)
-            eventMap.erase(luaEvent->funcRef);
+    if (overflow)
+        return ((now >> (LEVELS * SLOT_BITS)) + 1) << (LEVELS * SLOT_BITS);
+    return std::numeric_limits<uint64>::max();
+}
+
+void LuaEventWheel::Reschedule(LuaEvent* events)
+{
+    while (events)
+    {
+        LuaEvent* next = events->next;
+        --count;
+        Schedule(events);
+        events = next;
+    }
+}
+
+void LuaEventWheel::Cascade()
+{
+    if (!(now & ((uint64(1) << (LEVELS * SLOT_BITS)) - 1)))
+        Reschedule(Unlink(overflow));
+
+    for (uint32 level = LEVELS - 1; level > 0; --level)
+    {
+        uint32 shift = level * SLOT_BITS;
+        if (now & ((uint64(1) << shift) - 1))
+            continue;
+
+        uint32 slot = uint32(now >> shift) & (SLOTS - 1);
+        occupied[level] &= ~(uint64(1) << slot);
+        Reschedule(Unlink(slots[level][slot]));
+    }
+}
+
+void LuaEventWheel::Schedule(LuaEvent* luaEvent)
+{
+    ASSERT(luaEvent->expiry >= now);
+    ++count;
+
+    // The level is given by the highest bit the expiry and the current time differ in
+    uint64 diff = luaEvent->expiry ^ now;
+    uint32 level = 0;
+    while (diff >= SLOTS)
+    {
+        diff >>= SLOT_BITS;
+        ++level;
+    }
+
+    if (level >= LEVELS)
+    {
+        Link(overflow, luaEvent);
+        return;
+    }
 
-        if (luaEvent->state == LUAEVENT_STATE_RUN)
+    uint32 slot = uint32(luaEvent->expiry >> (level * SLOT_BITS)) & (SLOTS - 1);
+    occupied[level] |= uint64(1) << slot;
+    Link(slots[level][slot], luaEvent);
+}
+
+LuaEvent* LuaEventWheel::Advance(uint64 time)
+{
+    while (count)
+    {
+        int slot = NextSlot(0, uint32(now) & (SLOTS - 1));
+        if (slot >= 0)
         {
-            uint32 delay = luaEvent->delay;
-            bool remove = luaEvent->repeats == 1;
-            if (!remove)
-                AddEvent(luaEvent); // Reschedule before calling incase RemoveEvents used
+            uint64 due = (now & ~uint64(SLOTS - 1)) + uint32(slot);
+            if (due > time)
+                break;
 
-            // Call the timed event
-            (*E)->OnTimedEvent(luaEvent->funcRef, delay, luaEvent->repeats ? luaEvent->repeats-- : luaEvent->repeats, obj);
+            now = due;
+            occupied[0] &= ~(uint64(1) << slot);
+            LuaEvent* events = Unlink(slots[0][slot]);
+            for (LuaEvent* luaEvent = events; luaEvent; luaEvent = luaEvent->next)
+                --count;
+            return events;
+        }
 
-            if (!remove)
-                continue;
+        uint64 next = NextCascadeTime();
+        if (next > time)
+            break;
+
+        now = next;
+        Cascade();
+    }
+
+    now = time;
+    return NULL;
+}
+
+LuaEvent* LuaEventWheel::TakeAll()
+{
+    LuaEvent* events = Unlink(overflow);
+    for (uint32 level = 0; level < LEVELS; ++level)
+    {
+        for (uint32 slot = 0; slot < SLOTS; ++slot)
+        {
+            LuaEvent* head = Unlink(slots[level][slot]);
+            while (head)
+            {
+                LuaEvent* next = head->next;
+                head->next = events;
+                events = head;
+                head = next;
+            }
         }
+        occupied[level] = 0;
+    }
+    count = 0;
+    return events;
+}
 
-        // Event should be deleted (executed last time or set to be aborted)
-        RemoveEvent(luaEvent);
+ElunaEventProcessor::ElunaEventProcessor(Eluna* _E, WorldObject* _obj) : targetTime(0), lateEvents(NULL), dueEvents(NULL), dueCount(0), updating(false), obj(_obj), E(_E)
+{
+    // can be called from multiple threads
+    if (obj && E)
+    {
+        EventMgr::Guard guard(E->eventMgr->GetLock());
+        E->eventMgr->processors.insert(this);
+    }
+}
+
+ElunaEventProcessor::~ElunaEventProcessor()
+{
+    // The events were already removed if the owning state was destroyed
+    if (E)
+    {
+        // can be called from multiple threads
+        {
+            Eluna::Guard guard(E->GetStateLock());
+            RemoveEvents_internal();
+        }
+
+        if (obj && Eluna::IsInitialized())
+        {
+            EventMgr::Guard guard(E->eventMgr->GetLock());
+            E->eventMgr->processors.erase(this);
+        }
+    }
+
+    for (LuaEvent* luaEvent : eventPool)
+        delete luaEvent;
+}
+
+void ElunaEventProcessor::Update(uint32 diff, ElunaUtil::Deadline deadline)
+{
+    if (!E)
+        return;
+
+    // The wheel stays behind when the deadline passes, the target keeps counting so no time is lost
+    targetTime += diff;
+    updating = true;
+    LuaEvent* events = dueEvents;
+    dueEvents = NULL;
+    dueCount = 0;
+    while (events || (events = eventWheel.Advance(targetTime)))
+    {
+        LuaEvent* luaEvent = events;
+        events = events->next;
+        RunEvent(luaEvent);
+
+        if (ElunaUtil::IsPast(deadline))
+        {
+            dueEvents = events;
+            for (; events; events = events->next)
+                ++dueCount;
+            break;
+        }
+    }
+    updating = false;
+
+    // Events with no delay left run on the next update instead of looping forever
+    while (lateEvents)
+    {
+        LuaEvent* luaEvent = lateEvents;
+        lateEvents = lateEvents->next;
+        luaEvent->expiry = targetTime;
+        eventWheel.Schedule(luaEvent);
     }
 }
 
+void ElunaEventProcessor::RunEvent(LuaEvent* luaEvent)
+{
+    if (luaEvent->state != LUAEVENT_STATE_ERASE)
+        eventMap.erase(luaEvent->funcRef);
+
+    if (luaEvent->state == LUAEVENT_STATE_RUN)
+    {
+        uint32 delay = luaEvent->delay;
+        bool remove = luaEvent->repeats == 1;
+        if (!remove)
+            AddEvent(luaEvent); // Reschedule before calling incase RemoveEvents used
+
+        // Call the timed event
+        E->OnTimedEvent(luaEvent->funcRef, delay, luaEvent->repeats ? luaEvent->repeats-- : luaEvent->repeats, obj);
+
+        if (!remove)
+            return;
+    }
+
+    // Event should be deleted (executed last time or set to be aborted)
+    RemoveEvent(luaEvent);
+}
+
 void ElunaEventProcessor::SetStates(LuaEventState state)
 {
-    for (EventList::iterator it = eventList.begin(); it != eventList.end(); ++it)
+    // Every event that can still change state is in the map
+    for (EventMap::iterator it = eventMap.begin(); it != eventMap.end(); ++it)
         it->second->SetState(state);
     if (state == LUAEVENT_STATE_ERASE)
         eventMap.clear();
@@ -79,52 +296,100 @@ void ElunaEventProcessor::SetStates(LuaEventState state)
 
 void ElunaEventProcessor::RemoveEvents_internal()
 {
-    //if (!final)
-    //{
-    //    for (EventList::iterator it = eventList.begin(); it != eventList.end(); ++it)
-    //        it->second->to_Abort = true;
-    //    return;
-    //}
+    LuaEvent* luaEvent = eventWheel.TakeAll();
+    while (luaEvent)
+    {
+        LuaEvent* next = luaEvent->next;
+        RemoveEvent(luaEvent);
+        luaEvent = next;
+    }
 
-    for (EventList::iterator it = eventList.begin(); it != eventList.end(); ++it)
-        RemoveEvent(it->second);
+    while (lateEvents)
+    {
+        LuaEvent* next = lateEvents->next;
+        RemoveEvent(lateEvents);
+        lateEvents = next;
+    }
+
+    while (dueEvents)
+    {
+        LuaEvent* next = dueEvents->next;
+        RemoveEvent(dueEvents);
+        dueEvents = next;
+    }
+    dueCount = 0;
 
-    eventList.clear();
     eventMap.clear();
 }
 
 void ElunaEventProcessor::SetState(int eventId, LuaEventState state)
 {
-    if (eventMap.find(eventId) != eventMap.end())
-        eventMap[eventId]->SetState(state);
+    EventMap::iterator it = eventMap.find(eventId);
+    if (it == eventMap.end())
+        return;
+
+    it->second->SetState(state);
     if (state == LUAEVENT_STATE_ERASE)
-        eventMap.erase(eventId);
+        eventMap.erase(it);
 }
 
 void ElunaEventProcessor::AddEvent(LuaEvent* luaEvent)
 {
     luaEvent->GenerateDelay();
-    eventList.insert(std::pair<uint64, LuaEvent*>(m_time + luaEvent->delay, luaEvent));
+    // From the end of the update like the timers always were, not from the slot that just ran,
+    //   so a repeating event runs once per update after a long one instead of catching up
+    luaEvent->expiry = targetTime + luaEvent->delay;
     eventMap[luaEvent->funcRef] = luaEvent;
+
+    // The slot being run can't take new events until the update is done
+    if (updating && !luaEvent->delay)
+    {
+        luaEvent->next = lateEvents;
+        lateEvents = luaEvent;
+        return;
+    }
+
+    eventWheel.Schedule(luaEvent);
 }
 
 void ElunaEventProcessor::AddEvent(int funcRef, uint32 min, uint32 max, uint32 repeats)
 {
-    AddEvent(new LuaEvent(funcRef, min, max, repeats));
+    AddEvent(NewEvent(funcRef, min, max, repeats));
+    if (E)
+        E->eventMgr->IndexEvent(funcRef, this);
+}
+
+LuaEvent* ElunaEventProcessor::NewEvent(int funcRef, uint32 min, uint32 max, uint32 repeats)
+{
+    if (eventPool.empty())
+        return new LuaEvent(funcRef, min, max, repeats);
+
+    LuaEvent* luaEvent = eventPool.back();
+    eventPool.pop_back();
+    luaEvent->Reset(funcRef, min, max, repeats);
+    return luaEvent;
 }
 
 void ElunaEventProcessor::RemoveEvent(LuaEvent* luaEvent)
 {
     // Unreference if should and if Eluna was not yet uninitialized and if the lua state still exists
-    if (luaEvent->state != LUAEVENT_STATE_ERASE && Eluna::IsInitialized() && (*E)->HasLuaState())
+    if (luaEvent->state != LUAEVENT_STATE_ERASE && Eluna::IsInitialized() && E && E->HasLuaState())
     {
         // Free lua function ref
-        luaL_unref((*E)->L, LUA_REGISTRYINDEX, luaEvent->funcRef);
+        luaL_unref(E->L, LUA_REGISTRYINDEX, luaEvent->funcRef);
     }
-    delete luaEvent;
+
+    // Erased events were already dropped from the index, their ID may be in use again
+    if (luaEvent->state != LUAEVENT_STATE_ERASE && E)
+        E->eventMgr->UnindexEvent(luaEvent->funcRef, this);
+
+    if (eventPool.size() < MAX_POOLED_EVENTS)
+        eventPool.push_back(luaEvent);
+    else
+        delete luaEvent;
 }
 
-EventMgr::EventMgr(Eluna** _E) : globalProcessor(new ElunaEventProcessor(_E, NULL)), E(_E)
+EventMgr::EventMgr(Eluna* _E) : globalProcessor(new ElunaEventProcessor(_E, NULL)), E(_E)
 {
 }
 
@@ -133,8 +398,15 @@ EventMgr::~EventMgr()
     {
         Guard guard(GetLock());
         if (!processors.empty())
+        {
             for (ProcessorSet::const_iterator it = processors.begin(); it != processors.end(); ++it) // loop processors
+            {
                 (*it)->RemoveEvents_internal();
+                // Objects can outlive a map state, detach them so they no longer use it
+                (*it)->E = NULL;
+            }
+            processors.clear();
+        }
         globalProcessor->RemoveEvents_internal();
     }
     delete globalProcessor;
@@ -143,18 +415,75 @@ EventMgr::~EventMgr()
 
 void EventMgr::SetStates(LuaEventState state)
 {
-    Guard guard(GetLock());
-    if (!processors.empty())
-        for (ProcessorSet::const_iterator it = processors.begin(); it != processors.end(); ++it) // loop processors
-            (*it)->SetStates(state);
-    globalProcessor->SetStates(state);
+    {
+        Guard guard(GetLock());
+        if (!processors.empty())
+            for (ProcessorSet::const_iterator it = processors.begin(); it != processors.end(); ++it) // loop processors
+                if (!(*it)->eventMap.empty())
+                    (*it)->SetStates(state);
+        globalProcessor->SetStates(state);
+    }
+
+    if (state == LUAEVENT_STATE_ERASE)
+    {
+        Guard guard(indexLock);
+        eventIndex.clear();
+    }
 }
 
 void EventMgr::SetState(int eventId, LuaEventState state)
 {
-    Guard guard(GetLock());
-    if (!processors.empty())
-        for (ProcessorSet::const_iterator it = processors.begin(); it != processors.end(); ++it) // loop processors
-            (*it)->SetState(eventId, state);
-    globalProcessor->SetState(eventId, state);
+    Guard guard(indexLock);
+    EventIndex::iterator it = eventIndex.find(eventId);
+    if (it == eventIndex.end())
+        return;
+
+    it->second->SetState(eventId, state);
+    if (state == LUAEVENT_STATE_ERASE)
+        eventIndex.erase(it);
+}
+
+void EventMgr::IndexEvent(int eventId, ElunaEventProcessor* processor)
+{
+    Guard guard(indexLock);
+    eventIndex[eventId] = processor;
+}
+
+void EventMgr::UnindexEvent(int eventId, ElunaEventProcessor* processor)
+{
+    Guard guard(indexLock);
+    EventIndex::iterator it = eventIndex.find(eventId);
+    if (it != eventIndex.end() && it->second == processor)
+        eventIndex.erase(it);
+}
+
+void EventMgr::SwapGlobalEvents(EventMgr* other)
+{
+    {
+        Guard guard(GetLock());
+        Guard otherGuard(other->GetLock());
+        std::swap(globalProcessor, other->globalProcessor);
+        globalProcessor->E = E;
+        other->globalProcessor->E = other->E;
+    }
+
+    Guard guard(indexLock);
+    Guard otherGuard(other->indexLock);
+    for (EventIndex::iterator it = eventIndex.begin(); it != eventIndex.end();)
+    {
+        if (it->second == other->globalProcessor)
+            it = eventIndex.erase(it);
+        else
+            ++it;
+    }
+    for (EventIndex::iterator it = other->eventIndex.begin(); it != other->eventIndex.end();)
+    {
+        if (it->second == globalProcessor)
+        {
+            eventIndex[it->first] = globalProcessor;
+            it = other->eventIndex.erase(it);
+        }
+        else
+            ++it;
+    }
 }
@@ -10,7 +10,7 @@
 #include "ElunaUtility.h"
 #include "Common.h"
 #include "Util.h"
-#include <map>
+#include <vector>
 
 #include "Define.h"
 
@@ -29,10 +29,23 @@ enum LuaEventState
 struct LuaEvent
 {
     LuaEvent(int _funcRef, uint32 _min, uint32 _max, uint32 _repeats) :
-        min(_min), max(_max), delay(0), repeats(_repeats), funcRef(_funcRef), state(LUAEVENT_STATE_RUN)
+        min(_min), max(_max), delay(0), repeats(_repeats), funcRef(_funcRef), state(LUAEVENT_STATE_RUN), expiry(0), next(NULL)
     {
     }
 
+    // Reuses a pooled event for a new timer
+    void Reset(int _funcRef, uint32 _min, uint32 _max, uint32 _repeats)
+    {
+        min = _min;
+        max = _max;
+        delay = 0;
+        repeats = _repeats;
+        funcRef = _funcRef;
+        state = LUAEVENT_STATE_RUN;
+        expiry = 0;
+        next = NULL;
+    }
+
     void SetState(LuaEventState _state)
     {
         if (state != LUAEVENT_STATE_ERASE)
@@ -50,6 +63,54 @@ struct LuaEvent
     uint32 repeats; // Amount of repeats to make, 0 for infinite
     int funcRef;    // Lua function reference ID, also used as event ID
     LuaEventState state;    // State for next call
+    uint64 expiry;  // Processor time the event is due at
+    LuaEvent* next; // Next event in the same timer wheel slot
+};
+
+/*
+ * A hierarchical timing wheel holding the LuaEvents of one processor.
+ *
+ * Every level has 64 slots, a slot on level N spanning 64^N milliseconds.
+ *   An event is kept on the lowest level where its expiry and the current
+ *   time only differ within one slot, and moves down a level whenever the
+ *   wheel reaches that slot. Scheduling is O(1), and empty slots are
+ *   skipped with the per level occupancy bitmaps.
+ */
+class LuaEventWheel
+{
+public:
+    static const uint32 SLOT_BITS = 6;
+    static const uint32 SLOTS = 1 << SLOT_BITS;
+    static const uint32 LEVELS = 6;
+
+    LuaEventWheel();
+
+    uint64 GetTime() const { return now; }
+
+    // Adds the event to its slot, the expiry must not be in the past
+    void Schedule(LuaEvent* luaEvent);
+    // Moves the time forward to `time`, stopping early at the first slot with
+    //   events due until then. Returns the events of that slot in order.
+    LuaEvent* Advance(uint64 time);
+    // Removes and returns all events, in no particular order
+    LuaEvent* TakeAll();
+
+private:
+    // Slots are circular lists referenced by their last event, so appending keeps the order
+    static void Link(LuaEvent*& tail, LuaEvent* luaEvent);
+    static LuaEvent* Unlink(LuaEvent*& tail);
+
+    int NextSlot(uint32 level, uint32 from) const;
+    uint64 NextCascadeTime() const;
+    void Cascade();
+    void Reschedule(LuaEvent* events);
+
+    LuaEvent* slots[LEVELS][SLOTS];
+    uint64 occupied[LEVELS];
+    // Events too far ahead for the top level, only after years of uptime
+    LuaEvent* overflow;
+    uint64 now;
+    uint32 count;
 };
 
 class ElunaEventProcessor
@@ -57,48 +118,79 @@ class ElunaEventProcessor
     friend class EventMgr;
 
 public:
-    typedef std::multimap<uint64, LuaEvent*> EventList;
     typedef std::unordered_map<int, LuaEvent*> EventMap;
 
-    ElunaEventProcessor(Eluna** _E, WorldObject* _obj);
+    ElunaEventProcessor(Eluna* _E, WorldObject* _obj);
     ~ElunaEventProcessor();
 
-    void Update(uint32 diff);
+    // Events due after the deadline has passed are run by the next update, before any others
+    void Update(uint32 diff, ElunaUtil::Deadline deadline = ElunaUtil::NO_DEADLINE);
+    // Events that were due but left for the next update by a budgeted one
+    uint32 GetDueCount() const { return dueCount; }
     // removes all timed events on next tick or at tick end
     void SetStates(LuaEventState state);
     // set the event to be removed when executing
     void SetState(int eventId, LuaEventState state);
     void AddEvent(int funcRef, uint32 min, uint32 max, uint32 repeats);
+    // The state the events are registered in, NULL if the state was destroyed
+    Eluna* GetOwner() const { return E; }
     EventMap eventMap;
 
 private:
+    // Finished events kept for reuse, per processor so no locking is needed
+    static const size_t MAX_POOLED_EVENTS = 64;
+
     void RemoveEvents_internal();
+    void RunEvent(LuaEvent* luaEvent);
     void AddEvent(LuaEvent* luaEvent);
     void RemoveEvent(LuaEvent* luaEvent);
-    EventList eventList;
-    uint64 m_time;
+    LuaEvent* NewEvent(int funcRef, uint32 min, uint32 max, uint32 repeats);
+    LuaEventWheel eventWheel;
+    // Sum of the update diffs, the wheel is advanced towards it and repeating events are rescheduled from it
+    uint64 targetTime;
+    // Events rescheduled while the wheel is being advanced, added back once it is done
+    LuaEvent* lateEvents;
+    // Events taken from the wheel that a budgeted update had no time left for
+    LuaEvent* dueEvents;
+    uint32 dueCount;
+    bool updating;
+    std::vector<LuaEvent*> eventPool;
     WorldObject* obj;
-    Eluna** E;
+    Eluna* E;
 };
 
 class EventMgr : public ElunaUtil::Lockable
 {
 public:
     typedef std::unordered_set<ElunaEventProcessor*> ProcessorSet;
+    typedef std::unordered_map<int, ElunaEventProcessor*> EventIndex;
     ProcessorSet processors;
     ElunaEventProcessor* globalProcessor;
-    Eluna** E;
+    Eluna* E;
 
-    EventMgr(Eluna** _E);
+    EventMgr(Eluna* _E);
     ~EventMgr();
 
     // Set the state of all timed events
     // Execute only in safe env
     void SetStates(LuaEventState state);
 
-    // Sets the eventId's state in all processors
+    // Sets the eventId's state in the processor that has the event
     // Execute only in safe env
     void SetState(int eventId, LuaEventState state);
+
+    // Keep track of the processor an event was added to, until its reference is freed
+    void IndexEvent(int eventId, ElunaEventProcessor* processor);
+    void UnindexEvent(int eventId, ElunaEventProcessor* processor);
+
+    // Exchanges the global timed events with `other`, used when a state takes over the Lua state of another
+    void SwapGlobalEvents(EventMgr* other);
+
+private:
+    // Event ID -> processor, guarded by indexLock and not the processor set lock
+    // so processors can update it while the set is locked
+    EventIndex eventIndex;
+    LockType indexLock;
 };
 
 #endif
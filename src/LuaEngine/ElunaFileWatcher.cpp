@@ -8,8 +8,25 @@
 #include "LuaEngine.h"
 #include "ElunaUtility.h"
 #include <boost/filesystem.hpp>
+#include <algorithm>
 
-ElunaFileWatcher::ElunaFileWatcher() : running(false), checkInterval(1)
+#ifdef ELUNA_INOTIFY
+#include <sys/inotify.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint32 WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+    // How often an idle watcher thread checks whether it should stop
+    const int IDLE_POLL_MS = 500;
+}
+#endif
+
+ElunaFileWatcher::ElunaFileWatcher() : running(false), checkInterval(1), debounceTime(500)
 {
 }
 
@@ -18,7 +35,7 @@ ElunaFileWatcher::~ElunaFileWatcher()
     StopWatching();
 }
 
-void ElunaFileWatcher::StartWatching(const std::string& scriptPath, uint32 intervalSeconds)
+void ElunaFileWatcher::StartWatching(const std::string& scriptPath, uint32 intervalSeconds, uint32 debounceMs)
 {
     if (running.load())
     {
@@ -34,9 +51,20 @@ void ElunaFileWatcher::StartWatching(const std::string& scriptPath, uint32 inter
 
     watchPath = scriptPath;
     checkInterval = intervalSeconds;
+    debounceTime = debounceMs;
     running.store(true);
 
-    ScanDirectory(watchPath);
+#ifdef ELUNA_INOTIFY
+    if (StartInotify())
+    {
+        watcherThread = std::thread(&ElunaFileWatcher::InotifyLoop, this);
+
+        ELUNA_LOG_INFO("[ElunaFileWatcher]: Started watching '{}' with inotify ({} folders, debounce: {}ms)", watchPath, watches.size(), debounceTime);
+        return;
+    }
+#endif
+
+    ScanDirectory(watchPath, fileTimestamps);
 
     watcherThread = std::thread(&ElunaFileWatcher::WatchLoop, this);
     
@@ -53,6 +81,9 @@ void ElunaFileWatcher::StopWatching()
     if (watcherThread.joinable())
         watcherThread.join();
 
+#ifdef ELUNA_INOTIFY
+    StopInotify();
+#endif
     fileTimestamps.clear();
     
     ELUNA_LOG_INFO("[ElunaFileWatcher]: Stopped watching files");
@@ -60,18 +91,30 @@ void ElunaFileWatcher::StopWatching()
 
 void ElunaFileWatcher::WatchLoop()
 {
+    bool pending = false;
     while (running.load())
     {
         try
         {
-            CheckForChanges();
+            if (CheckForChanges())
+                pending = true;
+            else if (pending)
+            {
+                // Nothing changed since the last check, the files are done being written
+                ELUNA_LOG_INFO("[ElunaFileWatcher]: Lua script changes detected - triggering reload");
+                Eluna::ReloadEluna();
+                pending = false;
+            }
         }
         catch (const std::exception& e)
         {
             ELUNA_LOG_ERROR("[ElunaFileWatcher]: Error during file watching: {}", e.what());
         }
 
-        std::this_thread::sleep_for(std::chrono::seconds(checkInterval));
+        if (pending)
+            std::this_thread::sleep_for(std::chrono::milliseconds(debounceTime));
+        else
+            std::this_thread::sleep_for(std::chrono::seconds(checkInterval));
     }
 }
 
@@ -81,7 +124,7 @@ bool ElunaFileWatcher::IsWatchedFileType(const std::string& filename) {
         (filename.length() >= 5 && filename.substr(filename.length() - 5) == ".moon");
 }
 
-void ElunaFileWatcher::ScanDirectory(const std::string& path)
+void ElunaFileWatcher::ScanDirectory(const std::string& path, TimestampMap& timestamps)
 {
     try
     {
@@ -95,18 +138,21 @@ void ElunaFileWatcher::ScanDirectory(const std::string& path)
         for (boost::filesystem::directory_iterator dir_iter(dir); dir_iter != end_iter; ++dir_iter)
         {
             std::string fullpath = dir_iter->path().generic_string();
+            std::string filename = dir_iter->path().filename().generic_string();
+
+            // Hidden files and folders are not loaded either
+            if (filename[0] == '.')
+                continue;
             
             if (boost::filesystem::is_directory(dir_iter->status()))
             {
-                ScanDirectory(fullpath);
+                ScanDirectory(fullpath, timestamps);
             }
             else if (boost::filesystem::is_regular_file(dir_iter->status()))
             {
-                std::string filename = dir_iter->path().filename().generic_string();
-                
                 if (IsWatchedFileType(filename))
                 {
-                    fileTimestamps[fullpath] = boost::filesystem::last_write_time(dir_iter->path());
+                    timestamps[fullpath] = boost::filesystem::last_write_time(dir_iter->path());
                 }
             }
         }
@@ -117,100 +163,159 @@ void ElunaFileWatcher::ScanDirectory(const std::string& path)
     }
 }
 
-void ElunaFileWatcher::CheckForChanges()
+bool ElunaFileWatcher::CheckForChanges()
 {
-    bool hasChanges = false;
-    
-    try
+    // One pass over the tree, new, modified and deleted files all show up as a difference
+    TimestampMap timestamps;
+    ScanDirectory(watchPath, timestamps);
+    if (timestamps == fileTimestamps)
+        return false;
+
+    ELUNA_LOG_DEBUG("[ElunaFileWatcher]: Script changes found in '{}'", watchPath);
+    fileTimestamps.swap(timestamps);
+    return true;
+}
+
+#ifdef ELUNA_INOTIFY
+bool ElunaFileWatcher::StartInotify()
+{
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
     {
-        boost::filesystem::path dir(watchPath);
-        
-        if (!boost::filesystem::exists(dir) || !boost::filesystem::is_directory(dir))
-            return;
+        ELUNA_LOG_ERROR("[ElunaFileWatcher]: Could not initialize inotify, polling instead: {}", strerror(errno));
+        return false;
+    }
+
+    AddWatches(watchPath);
+    if (watches.empty())
+    {
+        StopInotify();
+        return false;
+    }
+    return true;
+}
+
+void ElunaFileWatcher::StopInotify()
+{
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+    inotifyFd = -1;
+    watches.clear();
+}
+
+void ElunaFileWatcher::AddWatches(const std::string& path)
+{
+    int wd = inotify_add_watch(inotifyFd, path.c_str(), WATCH_MASK);
+    if (wd < 0)
+    {
+        // Usually fs.inotify.max_user_watches being too low for the tree
+        ELUNA_LOG_ERROR("[ElunaFileWatcher]: Could not watch '{}': {}", path, strerror(errno));
+        return;
+    }
+    watches[wd] = path;
 
+    try
+    {
         boost::filesystem::directory_iterator end_iter;
-        
-        for (boost::filesystem::directory_iterator dir_iter(dir); dir_iter != end_iter; ++dir_iter)
+        for (boost::filesystem::directory_iterator dir_iter(path); dir_iter != end_iter; ++dir_iter)
         {
-            if (ShouldReloadFile(dir_iter->path().generic_string()))
-                hasChanges = true;
-        }
-        
-        for (auto it = fileTimestamps.begin(); it != fileTimestamps.end();)
-        {
-            if (!boost::filesystem::exists(it->first))
-            {
-                ELUNA_LOG_DEBUG("[ElunaFileWatcher]: File deleted: {}", it->first);
-                it = fileTimestamps.erase(it);
-                hasChanges = true;
-            }
-            else
-            {
-                ++it;
-            }
+            std::string filename = dir_iter->path().filename().generic_string();
+            if (filename[0] != '.' && boost::filesystem::is_directory(dir_iter->status()))
+                AddWatches(dir_iter->path().generic_string());
         }
     }
     catch (const std::exception& e)
     {
-        ELUNA_LOG_ERROR("[ElunaFileWatcher]: Error checking for changes: {}", e.what());
-        return;
+        ELUNA_LOG_ERROR("[ElunaFileWatcher]: Error scanning directory '{}': {}", path, e.what());
     }
+}
 
-    if (hasChanges)
+bool ElunaFileWatcher::ReadEvents()
+{
+    bool changed = false;
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+
+    // The descriptor is non-blocking, read until the queue is drained
+    ssize_t length;
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
     {
-        ELUNA_LOG_INFO("[ElunaFileWatcher]: Lua script changes detected - triggering reload");
-        Eluna::ReloadEluna();
-        
-        ScanDirectory(watchPath);
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            // Events were dropped, there is no telling what changed
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                changed = true;
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                watches.erase(event->wd);
+                continue;
+            }
+
+            auto watch = watches.find(event->wd);
+            if (watch == watches.end() || !event->len || event->name[0] == '.')
+                continue;
+
+            std::string fullpath = watch->second + "/" + event->name;
+            if (event->mask & IN_ISDIR)
+            {
+                // Folders moved in may already hold scripts, they are found by the reload
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    AddWatches(fullpath);
+                changed = true;
+            }
+            else if (IsWatchedFileType(event->name))
+            {
+                ELUNA_LOG_DEBUG("[ElunaFileWatcher]: File changed: {}", fullpath);
+                changed = true;
+            }
+        }
     }
+    return changed;
 }
 
-bool ElunaFileWatcher::ShouldReloadFile(const std::string& filepath)
+void ElunaFileWatcher::InotifyLoop()
 {
-    try
+    bool pending = false;
+    std::chrono::steady_clock::time_point lastChange;
+
+    while (running.load())
     {
-        boost::filesystem::path file(filepath);
-        
-        if (boost::filesystem::is_directory(file))
+        int timeout = IDLE_POLL_MS;
+        if (pending)
         {
-            boost::filesystem::directory_iterator end_iter;
-            
-            for (boost::filesystem::directory_iterator dir_iter(file); dir_iter != end_iter; ++dir_iter)
+            int64 quiet = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastChange).count();
+            if (quiet >= int64(debounceTime))
             {
-                if (ShouldReloadFile(dir_iter->path().generic_string()))
-                    return true;
+                ELUNA_LOG_INFO("[ElunaFileWatcher]: Lua script changes detected - triggering reload");
+                Eluna::ReloadEluna();
+                pending = false;
+                continue;
             }
-            return false;
+            timeout = std::min(timeout, int(int64(debounceTime) - quiet));
         }
-        
-        if (!boost::filesystem::is_regular_file(file))
-            return false;
-            
-        std::string filename = file.filename().generic_string();
 
-        if (!IsWatchedFileType(filename)) return false;
-            
-        auto currentTime = boost::filesystem::last_write_time(file);
-        auto it = fileTimestamps.find(filepath);
-        
-        if (it == fileTimestamps.end())
+        pollfd pfd = { inotifyFd, POLLIN, 0 };
+        int result = poll(&pfd, 1, timeout);
+        if (result < 0 && errno != EINTR)
         {
-            ELUNA_LOG_DEBUG("[ElunaFileWatcher]: New file detected: {}", filepath);
-            fileTimestamps[filepath] = currentTime;
-            return true;
+            ELUNA_LOG_ERROR("[ElunaFileWatcher]: inotify failed, polling instead: {}", strerror(errno));
+            StopInotify();
+            ScanDirectory(watchPath, fileTimestamps);
+            WatchLoop();
+            return;
         }
-        
-        if (it->second != currentTime)
+
+        if (result > 0 && ReadEvents())
         {
-            ELUNA_LOG_DEBUG("[ElunaFileWatcher]: File modified: {}", filepath);
-            it->second = currentTime;
-            return true;
+            pending = true;
+            lastChange = std::chrono::steady_clock::now();
         }
     }
-    catch (const std::exception& e)
-    {
-        ELUNA_LOG_ERROR("[ElunaFileWatcher]: Error checking file '{}': {}", filepath, e.what());
-    }
-    
-    return false;
 }
+#endif
@@ -12,32 +12,60 @@
 #include <map>
 #include <string>
 #include <chrono>
+#include <unordered_map>
 #include <boost/filesystem.hpp>
 #include "Common.h"
 
+#if defined(__linux__)
+#define ELUNA_INOTIFY
+#endif
+
+/*
+ * Watches the script folder and reloads Eluna when scripts change.
+ *
+ * On Linux inotify is used, with watches on every folder of the tree.
+ *   Elsewhere, or when inotify can not be set up, the tree is polled every
+ *   check interval instead. Either way the reload waits until no file has
+ *   changed for the debounce window, so a checkout touching many files
+ *   only reloads once.
+ */
 class ElunaFileWatcher
 {
 public:
     ElunaFileWatcher();
     ~ElunaFileWatcher();
 
-    void StartWatching(const std::string& scriptPath, uint32 intervalSeconds = 1);
+    void StartWatching(const std::string& scriptPath, uint32 intervalSeconds = 1, uint32 debounceMs = 500);
     void StopWatching();
     bool IsWatching() const { return running.load(); }
 
 private:
+    typedef std::map<std::string, std::time_t> TimestampMap;
+
     void WatchLoop();
-    void ScanDirectory(const std::string& path);
-    void CheckForChanges();
-    bool ShouldReloadFile(const std::string& filepath);
+    void ScanDirectory(const std::string& path, TimestampMap& timestamps);
+    bool CheckForChanges();
     bool IsWatchedFileType(const std::string& filename);
 
+#ifdef ELUNA_INOTIFY
+    bool StartInotify();
+    void StopInotify();
+    void InotifyLoop();
+    void AddWatches(const std::string& path);
+    bool ReadEvents();
+
+    int inotifyFd = -1;
+    // Watch descriptor -> watched folder
+    std::unordered_map<int, std::string> watches;
+#endif
+
     std::thread watcherThread;
     std::atomic<bool> running;
     std::string watchPath;
     uint32 checkInterval;
+    uint32 debounceTime;
     
-    std::map<std::string, std::time_t> fileTimestamps;
+    TimestampMap fileTimestamps;
 };
 
 #endif
@@ -55,8 +55,11 @@ private:
     //   either through `Load` or `Save`.
     std::string lastSaveData;
 
+    // The state that created the instance script and holds its data
+    Eluna* E;
+
 public:
-    ElunaInstanceAI(Map* map) : InstanceData(map)
+    ElunaInstanceAI(Eluna* _E, Map* map) : InstanceData(map), E(_E)
     {
     }
 
@@ -103,30 +106,30 @@ public:
         // If Eluna is reloaded, it will be missing our instance data.
         // Reload here instead of waiting for the next hook call (possibly never).
         // This avoids having to have an empty Update hook handler just to trigger the reload.
-        if (!sEluna->HasInstanceData(instance))
+        if (!E->HasInstanceData(instance))
             Reload();
 
-        sEluna->OnUpdateInstance(this, diff);
+        E->OnUpdateInstance(this, diff);
     }
 
     bool IsEncounterInProgress() const override
     {
-        return sEluna->OnCheckEncounterInProgress(const_cast<ElunaInstanceAI*>(this));
+        return E->OnCheckEncounterInProgress(const_cast<ElunaInstanceAI*>(this));
     }
 
     void OnPlayerEnter(Player* player) override
     {
-        sEluna->OnPlayerEnterInstance(this, player);
+        E->OnPlayerEnterInstance(this, player);
     }
 
     void OnGameObjectCreate(GameObject* gameobject) override
     {
-        sEluna->OnGameObjectCreate(this, gameobject);
+        E->OnGameObjectCreate(this, gameobject);
     }
 
     void OnCreatureCreate(Creature* creature) override
     {
-        sEluna->OnCreatureCreate(this, creature);
+        E->OnCreatureCreate(this, creature);
     }
 };
 
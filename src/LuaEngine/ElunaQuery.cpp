@@ -0,0 +1,227 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaQuery.h"
+#include "ElunaConfig.h"
+
+ElunaQueryData::ElunaQueryData(QueryResult result) : fieldCount(0), rowCount(0)
+{
+    // A query without rows is cached as well, it is as costly to repeat
+    if (!result || !result->Fetch())
+        return;
+
+    fieldCount = result->GetFieldCount();
+    names.reserve(fieldCount);
+    numeric.reserve(fieldCount);
+
+    Field* row = result->Fetch();
+    for (uint32 i = 0; i < fieldCount; ++i)
+    {
+        names.push_back(result->GetFieldName(i));
+        switch (row[i].GetType())
+        {
+            case DatabaseFieldTypes::Int8:
+            case DatabaseFieldTypes::Int16:
+            case DatabaseFieldTypes::Int32:
+            case DatabaseFieldTypes::Int64:
+            case DatabaseFieldTypes::Float:
+            case DatabaseFieldTypes::Double:
+                numeric.push_back(true);
+                break;
+            default:
+                numeric.push_back(false);
+                break;
+        }
+    }
+
+    values.reserve(size_t(result->GetRowCount()) * fieldCount);
+    nulls.reserve(size_t(result->GetRowCount()) * fieldCount);
+    do
+    {
+        row = result->Fetch();
+        for (uint32 i = 0; i < fieldCount; ++i)
+        {
+            bool isNull = row[i].IsNull();
+            nulls.push_back(isNull);
+            values.push_back(isNull ? std::string() : row[i].Get<std::string>());
+        }
+        ++rowCount;
+    } while (result->NextRow());
+}
+
+size_t ElunaQueryData::GetMemoryUsage() const
+{
+    size_t size = sizeof(ElunaQueryData) + values.capacity() * sizeof(std::string) + nulls.capacity() / 8;
+    for (const std::string& name : names)
+        size += sizeof(std::string) + name.capacity();
+
+    // Short strings are stored inside the std::string itself
+    for (const std::string& value : values)
+        if (value.capacity() > sizeof(std::string))
+            size += value.capacity();
+    return size;
+}
+
+bool ElunaQuery::NextRow()
+{
+    if (result)
+        return result->NextRow();
+
+    if (row < data->rowCount)
+        ++row;
+    return row < data->rowCount;
+}
+
+bool ElunaQuery::IsNull(uint32 index) const
+{
+    if (result)
+        return result->Fetch()[index].IsNull();
+    return data->nulls[row * data->fieldCount + index];
+}
+
+bool ElunaQuery::IsNumeric(uint32 index) const
+{
+    if (!result)
+        return data->numeric[index];
+
+    switch (result->Fetch()[index].GetType())
+    {
+        case DatabaseFieldTypes::Int8:
+        case DatabaseFieldTypes::Int16:
+        case DatabaseFieldTypes::Int32:
+        case DatabaseFieldTypes::Int64:
+        case DatabaseFieldTypes::Float:
+        case DatabaseFieldTypes::Double:
+            return true;
+        default:
+            return false;
+    }
+}
+
+ElunaQueryCache& ElunaQueryCache::GetInstance()
+{
+    static ElunaQueryCache instance;
+    return instance;
+}
+
+static std::string MakeKey(ElunaStatement::DatabaseType database, const std::string& query)
+{
+    std::string key(1, char('0' + database));
+    key += query;
+    return key;
+}
+
+std::shared_ptr<const ElunaQueryData> ElunaQueryCache::Get(ElunaStatement::DatabaseType database, const std::string& query)
+{
+    std::string key = MakeKey(database, query);
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto itr = entries.find(key);
+    if (itr == entries.end())
+    {
+        ++misses;
+        return nullptr;
+    }
+
+    if (itr->second.expires <= std::chrono::steady_clock::now())
+    {
+        Erase(itr);
+        ++misses;
+        return nullptr;
+    }
+
+    lru.splice(lru.begin(), lru, itr->second.lruPos);
+    ++hits;
+    return itr->second.data;
+}
+
+void ElunaQueryCache::Store(ElunaStatement::DatabaseType database, const std::string& query, std::shared_ptr<const ElunaQueryData> data, uint32 ttl, const std::vector<std::string>& tags)
+{
+    size_t limit = size_t(ElunaConfig::GetInstance().GetQueryCacheSize()) * 1024;
+    std::string key = MakeKey(database, query);
+    size_t size = data->GetMemoryUsage() + 2 * key.size();
+    if (!ttl || size > limit)
+        return;
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto itr = entries.find(key);
+    if (itr != entries.end())
+        Erase(itr);
+
+    while (!lru.empty() && memory + size > limit)
+        Erase(entries.find(lru.back()));
+
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.data = data;
+    entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(ttl);
+    entry.tags = tags;
+    entry.lruPos = lru.begin();
+    entry.size = size;
+    memory += size;
+
+    for (const std::string& tag : tags)
+        tagged[tag].insert(key);
+}
+
+void ElunaQueryCache::Erase(std::unordered_map<std::string, Entry>::iterator itr)
+{
+    for (const std::string& tag : itr->second.tags)
+    {
+        auto tagItr = tagged.find(tag);
+        if (tagItr == tagged.end())
+            continue;
+
+        tagItr->second.erase(itr->first);
+        if (tagItr->second.empty())
+            tagged.erase(tagItr);
+    }
+
+    memory -= itr->second.size;
+    lru.erase(itr->second.lruPos);
+    entries.erase(itr);
+}
+
+uint32 ElunaQueryCache::Invalidate(const std::string& tag)
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto tagItr = tagged.find(tag);
+    if (tagItr == tagged.end())
+        return 0;
+
+    // Erase changes the set, so the keys are copied first
+    std::vector<std::string> keys(tagItr->second.begin(), tagItr->second.end());
+    for (const std::string& key : keys)
+    {
+        auto itr = entries.find(key);
+        if (itr != entries.end())
+            Erase(itr);
+    }
+    return uint32(keys.size());
+}
+
+uint32 ElunaQueryCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    uint32 count = uint32(entries.size());
+    entries.clear();
+    lru.clear();
+    tagged.clear();
+    memory = 0;
+    return count;
+}
+
+uint32 ElunaQueryCache::GetEntryCount()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    return uint32(entries.size());
+}
+
+size_t ElunaQueryCache::GetMemoryUsage()
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+    return memory;
+}
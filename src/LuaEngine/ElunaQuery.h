@@ -0,0 +1,151 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_QUERY_H
+#define _ELUNA_QUERY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Common.h"
+#include "Database/Field.h"
+#include "Database/QueryResult.h"
+#include "ElunaStatement.h"
+
+/*
+ * All rows of a query result copied out of the core result set, read-only once created.
+ *
+ * The core result set is a cursor that frees its rows as it is read, so only
+ *   a copy can be shared by every script that reads a cached result.
+ */
+struct ElunaQueryData
+{
+    // Reads the rest of the result, from its current row to the last
+    explicit ElunaQueryData(QueryResult result);
+
+    // Approximate heap memory used by the copy
+    size_t GetMemoryUsage() const;
+
+    uint32 fieldCount;
+    uint64 rowCount;
+    std::vector<std::string> names;
+    std::vector<bool> numeric;
+    // Row after row as text, NULL values are empty and marked in nulls
+    std::vector<std::string> values;
+    std::vector<bool> nulls;
+};
+
+/*
+ * The result of a query as scripts see it, either a core result set read row
+ *   by row or a cursor over rows shared from the query cache.
+ */
+class ElunaQuery
+{
+public:
+    explicit ElunaQuery(QueryResult result) : result(result), row(0) { }
+    explicit ElunaQuery(std::shared_ptr<const ElunaQueryData> data) : data(data), row(0) { }
+
+    uint32 GetFieldCount() const { return result ? result->GetFieldCount() : data->fieldCount; }
+    uint64 GetRowCount() const { return result ? result->GetRowCount() : data->rowCount; }
+    // Only valid while there is a current row, the core frees the names with the last row
+    std::string GetFieldName(uint32 index) const { return result ? result->GetFieldName(index) : data->names[index]; }
+
+    // Returns false once NextRow went past the last row
+    bool HasRow() const { return result ? result->Fetch() != NULL : row < data->rowCount; }
+    bool NextRow();
+
+    bool IsNull(uint32 index) const;
+    // Integer and floating point columns, GetRow returns their values as numbers
+    bool IsNumeric(uint32 index) const;
+
+    template<typename T>
+    T Get(uint32 index) const
+    {
+        if (result)
+            return result->Fetch()[index].Get<T>();
+
+        const std::string& value = data->values[row * data->fieldCount + index];
+        if constexpr (std::is_same<T, std::string>::value)
+            return value;
+        else if constexpr (std::is_same<T, bool>::value)
+            return strtoll(value.c_str(), NULL, 10) != 0;
+        else if constexpr (std::is_floating_point<T>::value)
+            return T(strtod(value.c_str(), NULL));
+        else if constexpr (std::is_signed<T>::value)
+            return T(strtoll(value.c_str(), NULL, 10));
+        else
+            return T(strtoull(value.c_str(), NULL, 10));
+    }
+
+private:
+    QueryResult result;
+    std::shared_ptr<const ElunaQueryData> data;
+    uint64 row;
+};
+
+/*
+ * Results of queries run with the *DBQueryCached functions, shared by all Lua states.
+ *
+ * Results are found by their database and final query text. They expire after their
+ *   TTL, can be removed by tag, and the least recently used ones are removed to stay
+ *   under Eluna.QueryCacheSize kilobytes.
+ */
+class ElunaQueryCache
+{
+public:
+    static ElunaQueryCache& GetInstance();
+
+    // Returns nullptr if the query has no cached result or it has expired
+    std::shared_ptr<const ElunaQueryData> Get(ElunaStatement::DatabaseType database, const std::string& query);
+    void Store(ElunaStatement::DatabaseType database, const std::string& query, std::shared_ptr<const ElunaQueryData> data, uint32 ttl, const std::vector<std::string>& tags);
+    // Removes the results stored with the tag, returns how many were removed
+    uint32 Invalidate(const std::string& tag);
+    uint32 Clear();
+
+    uint64 GetHitCount() const { return hits; }
+    uint64 GetMissCount() const { return misses; }
+    uint32 GetEntryCount();
+    size_t GetMemoryUsage();
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    struct Entry
+    {
+        std::shared_ptr<const ElunaQueryData> data;
+        TimePoint expires;
+        std::vector<std::string> tags;
+        std::list<std::string>::iterator lruPos;
+        size_t size;
+    };
+
+    ElunaQueryCache() : memory(0), hits(0), misses(0) { }
+    ElunaQueryCache(const ElunaQueryCache&) = delete;
+    ElunaQueryCache& operator=(const ElunaQueryCache&) = delete;
+
+    // The cacheLock must be held
+    void Erase(std::unordered_map<std::string, Entry>::iterator itr);
+
+    std::mutex cacheLock;
+    // Entries by database number followed by the query text
+    std::unordered_map<std::string, Entry> entries;
+    // Keys of the entries, most recently used first
+    std::list<std::string> lru;
+    std::unordered_map<std::string, std::unordered_set<std::string>> tagged;
+    size_t memory;
+    std::atomic<uint64> hits;
+    std::atomic<uint64> misses;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaQueryProcessor.h"
+#include <iterator>
+
+void ElunaQueryProcessor::AddCallback(QueryCallback&& query)
+{
+    callbacks.emplace_back(std::move(query));
+}
+
+void ElunaQueryProcessor::AddCallback(TransactionCallback&& transaction)
+{
+    transactionCallbacks.emplace_back(std::move(transaction));
+}
+
+void ElunaQueryProcessor::AddStream(Stream&& stream)
+{
+    streams.emplace_back(std::move(stream));
+}
+
+void ElunaQueryProcessor::TakeCallbacks(ElunaQueryProcessor& other)
+{
+    std::move(other.callbacks.begin(), other.callbacks.end(), std::back_inserter(callbacks));
+    std::move(other.transactionCallbacks.begin(), other.transactionCallbacks.end(), std::back_inserter(transactionCallbacks));
+    std::move(other.streams.begin(), other.streams.end(), std::back_inserter(streams));
+    other.Clear();
+}
+
+void ElunaQueryProcessor::Clear()
+{
+    // The queries still run, only their results are ignored
+    callbacks.clear();
+    transactionCallbacks.clear();
+    streams.clear();
+}
+
+template<typename C>
+bool ElunaQueryProcessor::ProcessReady(std::deque<C>& queue, ElunaUtil::Deadline deadline)
+{
+    // Only the callbacks queued before this update are checked, the ones added by them wait for the next
+    for (size_t pending = queue.size(); pending > 0; --pending)
+    {
+        C callback(std::move(queue.front()));
+        queue.pop_front();
+
+        if (!callback.InvokeIfReady())
+        {
+            queue.push_back(std::move(callback));
+            continue;
+        }
+
+        if (ElunaUtil::IsPast(deadline))
+            return false;
+    }
+    return true;
+}
+
+void ElunaQueryProcessor::ProcessStreams(ElunaUtil::Deadline deadline)
+{
+    // Unfinished streams go to the back, so the ones left out at the deadline run first next time
+    for (size_t pending = streams.size(); pending > 0; --pending)
+    {
+        Stream stream(std::move(streams.front()));
+        streams.pop_front();
+
+        if (!stream())
+            streams.push_back(std::move(stream));
+
+        if (ElunaUtil::IsPast(deadline))
+            return;
+    }
+}
+
+void ElunaQueryProcessor::ProcessReadyCallbacks(ElunaUtil::Deadline deadline)
+{
+    if (ProcessReady(callbacks, deadline) && ProcessReady(transactionCallbacks, deadline))
+        ProcessStreams(deadline);
+}
@@ -0,0 +1,55 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_QUERY_PROCESSOR_H
+#define _ELUNA_QUERY_PROCESSOR_H
+
+#include <deque>
+#include <functional>
+#include "ElunaUtility.h"
+#include "Database/QueryCallback.h"
+#include "Database/Transaction.h"
+
+/*
+ * Runs the callbacks of async queries and transactions once their results are ready.
+ *
+ * Works like the core QueryCallbackProcessor, but can stop at a deadline.
+ *   Callbacks it had no time to check stay at the front of the queue and
+ *   are checked first by the next update.
+ *
+ * Streams are callbacks that handle a result over several updates, like the
+ *   *DBQueryStream functions. Each one runs once per update until it returns true.
+ */
+class ElunaQueryProcessor
+{
+public:
+    // Returns true once the stream is done and can be removed
+    typedef std::function<bool()> Stream;
+
+    void AddCallback(QueryCallback&& query);
+    void AddCallback(TransactionCallback&& transaction);
+    void AddStream(Stream&& stream);
+    // Moves the callbacks of a staged state over, when an async reload swaps in its Lua state
+    void TakeCallbacks(ElunaQueryProcessor& other);
+    // Callbacks hold references into the Lua state, they must be removed before it is closed
+    void Clear();
+    // Runs ready callbacks, then streams, until the deadline has passed, always at least one
+    void ProcessReadyCallbacks(ElunaUtil::Deadline deadline = ElunaUtil::NO_DEADLINE);
+    // Queries and transactions still waiting for their result or for their callback to run, and unfinished streams
+    size_t GetPendingCount() const { return callbacks.size() + transactionCallbacks.size() + streams.size(); }
+
+private:
+    // Returns false if it stopped at the deadline
+    template<typename C>
+    static bool ProcessReady(std::deque<C>& queue, ElunaUtil::Deadline deadline);
+    void ProcessStreams(ElunaUtil::Deadline deadline);
+
+    std::deque<QueryCallback> callbacks;
+    std::deque<TransactionCallback> transactionCallbacks;
+    std::deque<Stream> streams;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaScriptModules.h"
+#include "ElunaEventMgr.h"
+#include "LuaEngine.h"
+#include <algorithm>
+#include <cstring>
+
+extern "C"
+{
+#include "lauxlib.h"
+};
+
+const size_t ElunaScriptModules::MIN_PRUNE_SIZE;
+
+std::string ElunaScriptModules::GetCallerModule(lua_State* L)
+{
+    lua_Debug ar;
+    // Level 0 is the C function itself, skip C functions like pcall in between
+    for (int level = 1; lua_getstack(L, level, &ar); ++level)
+    {
+        if (!lua_getinfo(L, "S", &ar) || !ar.source)
+            break;
+
+        if (ar.source[0] == '@')
+            return ar.source + 1;
+        if (strcmp(ar.what, "C") != 0)
+            break;
+    }
+    return "";
+}
+
+std::string ElunaScriptModules::GetModuleName(const std::string& path)
+{
+    std::size_t start = path.find_last_of("/\\");
+    start = start == std::string::npos ? 0 : start + 1;
+    std::size_t extDot = path.find_last_of('.');
+    if (extDot == std::string::npos || extDot < start)
+        extDot = path.length();
+    return path.substr(start, extDot - start);
+}
+
+int ElunaScriptModules::Require(lua_State* L)
+{
+    std::string name = luaL_checkstring(L, 1);
+    Eluna::GetEluna(L)->scriptModules.AddRequire(GetCallerModule(L), name);
+
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+void ElunaScriptModules::AddBinding(lua_State* L, void* bindings, RemoveBinding remove, HasBinding has, uint64 id)
+{
+    std::string module = GetCallerModule(L);
+    if (module.empty())
+        return;
+
+    Module& tracked = modules[module];
+    if (tracked.bindings.size() >= tracked.pruneAt)
+    {
+        // Bindings with shots or cancelled ones are gone by now
+        tracked.bindings.erase(std::remove_if(tracked.bindings.begin(), tracked.bindings.end(), [](const TrackedBinding& binding)
+        {
+            return !binding.has(binding.bindings, binding.id);
+        }), tracked.bindings.end());
+        tracked.pruneAt = std::max(MIN_PRUNE_SIZE, tracked.bindings.size() * 2);
+    }
+
+    TrackedBinding binding = { bindings, remove, has, id };
+    tracked.bindings.push_back(binding);
+}
+
+void ElunaScriptModules::AddEvent(lua_State* L, int funcRef)
+{
+    // References are reused once an event is done, so the owner is always replaced
+    std::string module = GetCallerModule(L);
+    if (module.empty())
+        eventOwners.erase(funcRef);
+    else
+        eventOwners[funcRef] = module;
+}
+
+void ElunaScriptModules::AddRequire(const std::string& module, const std::string& name)
+{
+    if (!module.empty())
+        modules[module].requires.insert(name);
+}
+
+bool ElunaScriptModules::Module::Matches(const std::string& required, const std::string& name)
+{
+    // require("folder.name") and require("folder/name") find the script as well
+    if (required.length() < name.length() || required.compare(required.length() - name.length(), name.length(), name) != 0)
+        return false;
+    if (required.length() == name.length())
+        return true;
+
+    char separator = required[required.length() - name.length() - 1];
+    return separator == '.' || separator == '/';
+}
+
+bool ElunaScriptModules::Module::Requires(const std::string& name) const
+{
+    for (const std::string& required : requires)
+        if (Matches(required, name))
+            return true;
+    return false;
+}
+
+void ElunaScriptModules::AddDependents(std::unordered_set<std::string>& paths) const
+{
+    std::vector<std::string> pending(paths.begin(), paths.end());
+    while (!pending.empty())
+    {
+        std::string name = GetModuleName(pending.back());
+        pending.pop_back();
+
+        for (const auto& module : modules)
+        {
+            if (paths.find(module.first) != paths.end() || !module.second.Requires(name))
+                continue;
+
+            paths.insert(module.first);
+            pending.push_back(module.first);
+        }
+    }
+}
+
+void ElunaScriptModules::GetRequireNames(const std::string& path, std::unordered_set<std::string>& names) const
+{
+    std::string name = GetModuleName(path);
+    names.insert(name);
+    for (const auto& module : modules)
+        for (const std::string& required : module.second.requires)
+            if (Module::Matches(required, name))
+                names.insert(required);
+}
+
+void ElunaScriptModules::Unload(const std::string& module, EventMgr* eventMgr)
+{
+    auto it = modules.find(module);
+    if (it != modules.end())
+    {
+        for (const TrackedBinding& binding : it->second.bindings)
+            binding.remove(binding.bindings, binding.id);
+        modules.erase(it);
+    }
+
+    for (auto owner = eventOwners.begin(); owner != eventOwners.end();)
+    {
+        if (owner->second == module)
+        {
+            eventMgr->SetState(owner->first, LUAEVENT_STATE_ABORT);
+            owner = eventOwners.erase(owner);
+        }
+        else
+            ++owner;
+    }
+}
+
+void ElunaScriptModules::Clear()
+{
+    modules.clear();
+    eventOwners.clear();
+}
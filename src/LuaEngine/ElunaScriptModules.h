@@ -0,0 +1,86 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_SCRIPT_MODULES_H
+#define _ELUNA_SCRIPT_MODULES_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Common.h"
+
+extern "C"
+{
+#include "lua.h"
+};
+
+class EventMgr;
+
+/*
+ * Keeps track of what every script file of a Lua state created, so a single
+ *   changed script can be reloaded without closing the whole state.
+ *
+ * Bindings, timed events and require() calls are credited to the script
+ *   defining the Lua function that made them, so anything registered later
+ *   from a script's handlers belongs to that script as well.
+ */
+class ElunaScriptModules
+{
+public:
+    typedef void (*RemoveBinding)(void* bindings, uint64 id);
+    typedef bool (*HasBinding)(void* bindings, uint64 id);
+
+    // Returns the path of the script running the C function called from `L`, empty if not called from a script
+    static std::string GetCallerModule(lua_State* L);
+    // Returns the package.loaded name of the script at `path`
+    static std::string GetModuleName(const std::string& path);
+    // Replacement for require() recording which script requires what, the original is upvalue 1
+    static int Require(lua_State* L);
+
+    void AddBinding(lua_State* L, void* bindings, RemoveBinding remove, HasBinding has, uint64 id);
+    void AddEvent(lua_State* L, int funcRef);
+    void AddRequire(const std::string& module, const std::string& name);
+
+    // Adds every script requiring one of `paths`, directly or through other scripts
+    void AddDependents(std::unordered_set<std::string>& paths) const;
+    // Adds every name the script at `path` was required by, as package.loaded keeps each of them
+    void GetRequireNames(const std::string& path, std::unordered_set<std::string>& names) const;
+    // Removes the bindings of the script and aborts its timed events
+    void Unload(const std::string& module, EventMgr* eventMgr);
+    void Clear();
+
+private:
+    struct TrackedBinding
+    {
+        void* bindings;
+        RemoveBinding remove;
+        HasBinding has;
+        uint64 id;
+    };
+
+    struct Module
+    {
+        Module() : pruneAt(MIN_PRUNE_SIZE) { }
+
+        bool Requires(const std::string& name) const;
+        // Returns true if require(required) finds the script with the module name `name`
+        static bool Matches(const std::string& required, const std::string& name);
+
+        std::vector<TrackedBinding> bindings;
+        // Binding count at which bindings removed in the meantime are dropped from the list
+        size_t pruneAt;
+        std::unordered_set<std::string> requires;
+    };
+
+    static const size_t MIN_PRUNE_SIZE = 64;
+
+    std::unordered_map<std::string, Module> modules;
+    // Timed event function reference -> script that created the event
+    std::unordered_map<int, std::string> eventOwners;
+};
+
+#endif
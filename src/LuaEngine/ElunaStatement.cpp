@@ -0,0 +1,156 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaStatement.h"
+#include <cmath>
+#include <limits>
+#include <fmt/format.h>
+
+ElunaStatement::ElunaStatement(DatabaseType database, const std::string& sql) : database(database), fragmentsSize(sql.size())
+{
+    // Question marks inside quoted literals and identifiers are not placeholders
+    char quote = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < sql.size(); ++i)
+    {
+        char c = sql[i];
+        if (quote)
+        {
+            if (c == '\\' && quote != '`')
+                ++i;
+            else if (c == quote)
+                quote = 0;
+        }
+        else if (c == '\'' || c == '"' || c == '`')
+            quote = c;
+        else if (c == '?')
+        {
+            fragments.push_back(sql.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    fragments.push_back(sql.substr(start));
+
+    values.resize(fragments.size() - 1);
+    bound.resize(values.size(), false);
+}
+
+void ElunaStatement::SetValue(uint32 index, std::string&& literal)
+{
+    values[index] = std::move(literal);
+    bound[index] = true;
+}
+
+void ElunaStatement::ClearValues()
+{
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i].clear();
+        bound[i] = false;
+    }
+}
+
+bool ElunaStatement::Build(std::string& sql, uint32& missing) const
+{
+    size_t size = fragmentsSize;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (!bound[i])
+        {
+            missing = uint32(i);
+            return false;
+        }
+        size += values[i].size();
+    }
+
+    sql.clear();
+    sql.reserve(size);
+    sql += fragments[0];
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        sql += values[i];
+        sql += fragments[i + 1];
+    }
+    return true;
+}
+
+std::string ElunaStatement::FormatInteger(int64 value)
+{
+    return std::to_string(value);
+}
+
+std::string ElunaStatement::FormatUnsigned(uint64 value)
+{
+    return std::to_string(value);
+}
+
+std::string ElunaStatement::FormatFloat(float value)
+{
+    if (!std::isfinite(value))
+        return "NULL";
+
+    // Formatted as a float, 0.1f is written as 0.1 and not as the double it widens to
+    return fmt::format("{}", value);
+}
+
+std::string ElunaStatement::FormatNumber(double value)
+{
+    // Whole numbers are written without a fraction so they compare exactly against integer columns
+    if (std::trunc(value) == value && std::fabs(value) < 9007199254740992.0)
+        return std::to_string(int64(value));
+
+    // SQL has no literal for these
+    if (!std::isfinite(value))
+        return "NULL";
+
+    // Shortest text that reads back as the same double
+    return fmt::format("{}", value);
+}
+
+std::string ElunaStatement::FormatString(const char* value, size_t length)
+{
+    // The same characters as mysql_real_escape_string for utf8 connections
+    std::string literal;
+    literal.reserve(length + 2);
+    literal += '\'';
+    for (size_t i = 0; i < length; ++i)
+    {
+        char c = value[i];
+        switch (c)
+        {
+            case '\0':   literal += "\\0"; break;
+            case '\n':   literal += "\\n"; break;
+            case '\r':   literal += "\\r"; break;
+            case '\\':   literal += "\\\\"; break;
+            case '\'':   literal += "\\'"; break;
+            case '"':    literal += "\\\""; break;
+            case '\x1a': literal += "\\Z"; break;
+            default:     literal += c; break;
+        }
+    }
+    literal += '\'';
+    return literal;
+}
+
+std::string ElunaStatement::FormatBinary(const char* value, size_t length)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    if (!length)
+        return "''";
+
+    std::string literal;
+    literal.reserve(length * 2 + 3);
+    literal += "X'";
+    for (size_t i = 0; i < length; ++i)
+    {
+        uint8 byte = uint8(value[i]);
+        literal += digits[byte >> 4];
+        literal += digits[byte & 0x0F];
+    }
+    literal += '\'';
+    return literal;
+}
@@ -0,0 +1,59 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_STATEMENT_H
+#define _ELUNA_STATEMENT_H
+
+#include <string>
+#include <vector>
+#include "Common.h"
+
+/*
+ * A query declared once by a script and run many times with different parameters.
+ *
+ * The query is split at its `?` placeholders when it is declared. Bound values
+ *   are formatted into SQL literals right away, so running the statement only
+ *   joins the pieces together instead of searching and formatting the text again.
+ */
+class ElunaStatement
+{
+public:
+    enum DatabaseType
+    {
+        DATABASE_WORLD      = 0,
+        DATABASE_CHARACTER  = 1,
+        DATABASE_LOGIN      = 2,
+    };
+
+    ElunaStatement(DatabaseType database, const std::string& sql);
+
+    DatabaseType GetDatabase() const { return database; }
+    uint32 GetParameterCount() const { return uint32(values.size()); }
+
+    // The value must already be a SQL literal, see the Format functions
+    void SetValue(uint32 index, std::string&& literal);
+    void ClearValues();
+
+    // Returns false if a parameter has no value, its index is set to missing
+    bool Build(std::string& sql, uint32& missing) const;
+
+    static std::string FormatInteger(int64 value);
+    static std::string FormatUnsigned(uint64 value);
+    static std::string FormatFloat(float value);
+    static std::string FormatNumber(double value);
+    static std::string FormatString(const char* value, size_t length);
+    static std::string FormatBinary(const char* value, size_t length);
+
+private:
+    DatabaseType database;
+    // Text around the placeholders, always one more than there are values
+    std::vector<std::string> fragments;
+    std::vector<std::string> values;
+    std::vector<bool> bound;
+    size_t fragmentsSize;
+};
+
+#endif
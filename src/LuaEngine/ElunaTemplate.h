@@ -59,7 +59,7 @@ class ElunaObject
 {
 public:
     template<typename T>
-    ElunaObject(T * obj, bool manageMemory);
+    ElunaObject(Eluna* _E, T * obj, bool manageMemory);
 
     ~ElunaObject()
     {
@@ -68,7 +68,7 @@ public:
     // Get wrapped object pointer
     void* GetObj() const { return object; }
     // Returns whether the object is valid or not
-    bool IsValid() const { return !callstackid || callstackid == sEluna->GetCallstackId(); }
+    bool IsValid() const { return !callstackid || callstackid == *callstack; }
     // Returns whether the object can be invalidated or not
     bool CanInvalidate() const { return _invalidate; }
     // Returns pointer to the wrapped object's type name
@@ -87,7 +87,7 @@ public:
         ASSERT(!valid || (valid && object));
         if (valid)
             if (CanInvalidate())
-                callstackid = sEluna->GetCallstackId();
+                callstackid = *callstack;
             else
                 callstackid = 0;
         else
@@ -106,6 +106,8 @@ public:
     }
 
 private:
+    // Call stack counter of the Eluna state the object was pushed to
+    const uint64* callstack;
     uint64 callstackid;
     bool _invalidate;
     void* object;
@@ -268,7 +270,7 @@ public:
             lua_pushnil(L);
             return 1;
         }
-        *ptrHold = new ElunaObject(const_cast<T*>(obj), manageMemory);
+        *ptrHold = new ElunaObject(Eluna::GetEluna(L), const_cast<T*>(obj), manageMemory);
 
         // Set metatable for it
         lua_pushstring(L, tname);
@@ -378,7 +380,7 @@ public:
 };
 
 template<typename T>
-ElunaObject::ElunaObject(T * obj, bool manageMemory) : callstackid(1), _invalidate(!manageMemory), object(obj), type_name(ElunaTemplate<T>::tname)
+ElunaObject::ElunaObject(Eluna* _E, T * obj, bool manageMemory) : callstack(_E->GetCallstackCounter()), callstackid(1), _invalidate(!manageMemory), object(obj), type_name(ElunaTemplate<T>::tname)
 {
     SetValid(true);
 }
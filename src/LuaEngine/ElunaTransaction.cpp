@@ -0,0 +1,99 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaTransaction.h"
+#include <algorithm>
+
+std::vector<std::string> ElunaTransaction::TakeQueries()
+{
+    std::vector<std::string> taken;
+    taken.swap(queries);
+    return taken;
+}
+
+std::string ElunaBulkInsert::QuoteIdentifier(const std::string& name)
+{
+    // Backticks in the name are doubled, `db.table` names stay split at the dot
+    std::string quoted = "`";
+    for (char c : name)
+    {
+        if (c == '`')
+            quoted += "``";
+        else if (c == '.')
+            quoted += "`.`";
+        else
+            quoted += c;
+    }
+    quoted += '`';
+    return quoted;
+}
+
+ElunaBulkInsert::ElunaBulkInsert(ElunaStatement::DatabaseType database, const std::string& table, const std::vector<std::string>& columns, uint32 rowsPerStatement, const std::string& suffix)
+    : database(database), suffix(suffix), columnCount(uint32(columns.size())), rowsPerStatement(std::max<uint32>(1, rowsPerStatement)), rowCount(0), currentRows(0)
+{
+    header = "INSERT INTO " + QuoteIdentifier(table) + " (";
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (i)
+            header += ", ";
+        header += QuoteIdentifier(columns[i]);
+    }
+    header += ") VALUES ";
+}
+
+void ElunaBulkInsert::AddRow(const std::vector<std::string>& values)
+{
+    size_t rowSize = 2;
+    for (const std::string& value : values)
+        rowSize += value.size() + 1;
+
+    if (currentRows && (currentRows >= rowsPerStatement || current.size() + rowSize + 1 + suffix.size() > MAX_STATEMENT_SIZE))
+        FinishStatement();
+
+    if (!currentRows)
+        current = header;
+    else
+        current += ',';
+
+    current += '(';
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (i)
+            current += ',';
+        current += values[i];
+    }
+    current += ')';
+
+    ++currentRows;
+    ++rowCount;
+}
+
+void ElunaBulkInsert::FinishStatement()
+{
+    current += suffix;
+    statements.push_back(std::move(current));
+    current.clear();
+    currentRows = 0;
+}
+
+void ElunaBulkInsert::Flush(ElunaTransaction& transaction)
+{
+    if (currentRows)
+        FinishStatement();
+
+    for (std::string& statement : statements)
+        transaction.Append(std::move(statement));
+
+    Clear();
+}
+
+void ElunaBulkInsert::Clear()
+{
+    statements.clear();
+    current.clear();
+    currentRows = 0;
+    rowCount = 0;
+}
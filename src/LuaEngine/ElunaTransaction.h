@@ -0,0 +1,80 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_TRANSACTION_H
+#define _ELUNA_TRANSACTION_H
+
+#include <string>
+#include <vector>
+#include "ElunaStatement.h"
+
+/*
+ * Queries gathered by a script and committed together as one core transaction.
+ *
+ * The queries are kept as text until the commit, so the same transaction
+ *   object can be filled and committed again.
+ */
+class ElunaTransaction
+{
+public:
+    explicit ElunaTransaction(ElunaStatement::DatabaseType database) : database(database) { }
+
+    ElunaStatement::DatabaseType GetDatabase() const { return database; }
+    uint32 GetSize() const { return uint32(queries.size()); }
+
+    void Append(std::string&& sql) { queries.push_back(std::move(sql)); }
+    void Clear() { queries.clear(); }
+    // Leaves the transaction empty
+    std::vector<std::string> TakeQueries();
+
+private:
+    ElunaStatement::DatabaseType database;
+    std::vector<std::string> queries;
+};
+
+/*
+ * Rows for one table turned into multi-row INSERT statements.
+ *
+ * Each statement holds up to rowsPerStatement rows and stays under
+ *   MAX_STATEMENT_SIZE bytes, so it fits in the default max_allowed_packet.
+ *   The suffix, e.g. an ON DUPLICATE KEY UPDATE clause, ends every statement.
+ */
+class ElunaBulkInsert
+{
+public:
+    static const size_t MAX_STATEMENT_SIZE = 1024 * 1024;
+
+    ElunaBulkInsert(ElunaStatement::DatabaseType database, const std::string& table, const std::vector<std::string>& columns, uint32 rowsPerStatement, const std::string& suffix = "");
+
+    ElunaStatement::DatabaseType GetDatabase() const { return database; }
+    uint32 GetColumnCount() const { return columnCount; }
+    uint32 GetRowCount() const { return rowCount; }
+
+    // The values must already be SQL literals, see ElunaStatement, one per column
+    void AddRow(const std::vector<std::string>& values);
+    // Appends the statements for the rows added so far and removes the rows
+    void Flush(ElunaTransaction& transaction);
+    void Clear();
+
+    // Quotes a table or column name with backticks
+    static std::string QuoteIdentifier(const std::string& name);
+
+private:
+    void FinishStatement();
+
+    ElunaStatement::DatabaseType database;
+    // INSERT INTO `table` (`column`, ...) VALUES
+    std::string header;
+    std::string suffix;
+    uint32 columnCount;
+    uint32 rowsPerStatement;
+    uint32 rowCount;
+    uint32 currentRows;
+    std::string current;
+    std::vector<std::string> statements;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #ifndef _ELUNA_UTIL_H
 #define _ELUNA_UTIL_H
 
+#include <chrono>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
@@ -17,7 +18,6 @@
 #include "Database/QueryResult.h"
 #include "Log.h"
 
-typedef QueryResult ElunaQuery;
 #define GET_GUID                GetGUID
 #define HIGHGUID_PLAYER         HighGuid::Player
 #define HIGHGUID_UNIT           HighGuid::Unit
@@ -60,6 +60,16 @@ namespace ElunaUtil
 
     uint32 GetTimeDiff(uint32 oldMSTime);
 
+    // Time a budgeted update has to stop at, see Eluna.UpdateBudget
+    typedef std::chrono::steady_clock::time_point Deadline;
+    const Deadline NO_DEADLINE = Deadline::max();
+
+    // Work is always allowed to run past NO_DEADLINE, without reading the clock
+    inline bool IsPast(const Deadline& deadline)
+    {
+        return deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline;
+    }
+
     class ObjectGUIDCheck
     {
     public:
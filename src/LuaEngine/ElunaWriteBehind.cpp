@@ -0,0 +1,252 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaWriteBehind.h"
+#include "ElunaConfig.h"
+#include "ElunaUtility.h"
+#include "DatabaseEnv.h"
+#include <algorithm>
+#include <thread>
+
+template<typename T>
+static std::optional<TransactionCallback> CommitQueries(DatabaseWorkerPool<T>& db, const std::vector<std::string>& queries, bool wait)
+{
+    SQLTransaction<T> trans = db.BeginTransaction();
+    for (const std::string& query : queries)
+        trans->Append(query.c_str());
+
+    if (wait)
+    {
+        db.DirectCommitTransaction(trans);
+        return std::nullopt;
+    }
+    return db.AsyncCommitTransaction(trans);
+}
+
+ElunaWriteBehindTable::ElunaWriteBehindTable(ElunaStatement::DatabaseType database, const std::string& name, const std::vector<std::string>& keyColumns)
+    : database(database), name(name), keyColumns(keyColumns), flushRequested(false)
+{
+}
+
+bool ElunaWriteBehindTable::IsKeyColumn(const std::string& column) const
+{
+    return std::find(keyColumns.begin(), keyColumns.end(), column) != keyColumns.end();
+}
+
+uint32 ElunaWriteBehindTable::GetDirtyCount() const
+{
+    std::lock_guard<std::mutex> guard(rowsLock);
+    return uint32(rows.size());
+}
+
+void ElunaWriteBehindTable::Set(std::vector<std::string>&& key, std::vector<std::pair<std::string, std::string>>&& values)
+{
+    std::string id;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        if (i)
+            id += '\0';
+        id += key[i];
+    }
+
+    std::lock_guard<std::mutex> guard(rowsLock);
+    Row& row = rows[id];
+    if (row.key.empty())
+        row.key = std::move(key);
+
+    for (std::pair<std::string, std::string>& value : values)
+        row.values[value.first] = std::move(value.second);
+}
+
+bool ElunaWriteBehindTable::IsWriteDone()
+{
+    if (pendingWrite && pendingWrite->InvokeIfReady())
+        pendingWrite.reset();
+    return !pendingWrite;
+}
+
+void ElunaWriteBehindTable::Update(bool due)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+    if (!IsWriteDone())
+        return;
+
+    if (due || flushRequested)
+        Write(false);
+}
+
+void ElunaWriteBehindTable::Flush()
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+    if (IsWriteDone())
+        Write(false);
+    else
+        flushRequested = true;
+}
+
+void ElunaWriteBehindTable::RequestFlush()
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+    flushRequested = true;
+}
+
+void ElunaWriteBehindTable::FlushAndWait()
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+    while (!IsWriteDone())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    Write(true);
+}
+
+void ElunaWriteBehindTable::Write(bool wait)
+{
+    flushRequested = false;
+
+    // Scripts can keep setting values while the statements are built
+    std::shared_ptr<std::unordered_map<std::string, Row>> dirty = std::make_shared<std::unordered_map<std::string, Row>>();
+    {
+        std::lock_guard<std::mutex> guard(rowsLock);
+        dirty->swap(rows);
+    }
+
+    if (dirty->empty())
+        return;
+
+    // Rows setting the same columns are inserted with the same statements
+    std::map<std::vector<std::string>, std::vector<const Row*>> groups;
+    for (const std::pair<const std::string, Row>& pair : *dirty)
+    {
+        std::vector<std::string> columns;
+        columns.reserve(pair.second.values.size());
+        for (const std::pair<const std::string, std::string>& value : pair.second.values)
+            columns.push_back(value.first);
+        groups[columns].push_back(&pair.second);
+    }
+
+    ElunaTransaction trans(database);
+    for (const std::pair<const std::vector<std::string>, std::vector<const Row*>>& group : groups)
+    {
+        std::vector<std::string> columns = keyColumns;
+        columns.insert(columns.end(), group.first.begin(), group.first.end());
+
+        std::string suffix = " ON DUPLICATE KEY UPDATE ";
+        for (size_t i = 0; i < group.first.size(); ++i)
+        {
+            if (i)
+                suffix += ", ";
+            std::string column = ElunaBulkInsert::QuoteIdentifier(group.first[i]);
+            suffix += column + " = VALUES(" + column + ")";
+        }
+
+        ElunaBulkInsert bulk(database, name, columns, ROWS_PER_STATEMENT, suffix);
+        std::vector<std::string> values;
+        for (const Row* row : group.second)
+        {
+            values = row->key;
+            for (const std::pair<const std::string, std::string>& value : row->values)
+                values.push_back(value.second);
+            bulk.AddRow(values);
+        }
+        bulk.Flush(trans);
+    }
+
+    std::optional<TransactionCallback> callback;
+    switch (database)
+    {
+        case ElunaStatement::DATABASE_WORLD:
+            callback = CommitQueries(WorldDatabase, trans.TakeQueries(), wait);
+            break;
+        case ElunaStatement::DATABASE_CHARACTER:
+            callback = CommitQueries(CharacterDatabase, trans.TakeQueries(), wait);
+            break;
+        case ElunaStatement::DATABASE_LOGIN:
+            callback = CommitQueries(LoginDatabase, trans.TakeQueries(), wait);
+            break;
+    }
+
+    if (!callback)
+        return;
+
+    callback->AfterComplete([this, dirty](bool success)
+        {
+            if (success)
+                return;
+
+            ELUNA_LOG_ERROR("[Eluna]: Writing {} buffered rows to table {} failed, they are kept for the next write", dirty->size(), name);
+            Restore(*dirty);
+        });
+    pendingWrite = std::move(callback);
+}
+
+void ElunaWriteBehindTable::Restore(std::unordered_map<std::string, Row>& failed)
+{
+    std::lock_guard<std::mutex> guard(rowsLock);
+    for (std::pair<const std::string, Row>& pair : failed)
+    {
+        std::unordered_map<std::string, Row>::iterator row = rows.find(pair.first);
+        if (row == rows.end())
+        {
+            rows.emplace(pair.first, std::move(pair.second));
+            continue;
+        }
+
+        // Columns not set again since the write still need the failed value
+        for (std::pair<const std::string, std::string>& value : pair.second.values)
+            row->second.values.emplace(value.first, std::move(value.second));
+    }
+}
+
+ElunaWriteBehindMgr& ElunaWriteBehindMgr::GetInstance()
+{
+    static ElunaWriteBehindMgr instance;
+    return instance;
+}
+
+ElunaWriteBehindTable* ElunaWriteBehindMgr::GetTable(ElunaStatement::DatabaseType database, const std::string& name, const std::vector<std::string>& keyColumns)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<ElunaWriteBehindTable>& table = tables[std::make_pair(database, name)];
+    if (!table)
+        table = std::make_unique<ElunaWriteBehindTable>(database, name, keyColumns);
+    else if (table->GetKeyColumns() != keyColumns)
+        return NULL;
+
+    return table.get();
+}
+
+void ElunaWriteBehindMgr::Update(uint32 diff)
+{
+    bool due = false;
+    if (uint32 interval = ElunaConfig::GetInstance().GetWriteBehindInterval())
+    {
+        timer += diff;
+        if (timer >= interval)
+        {
+            timer = 0;
+            due = true;
+        }
+    }
+
+    // Tables are also checked between intervals, for finished writes and requested flushes
+    std::lock_guard<std::mutex> guard(lock);
+    for (TableMap::value_type& table : tables)
+        table.second->Update(due);
+}
+
+void ElunaWriteBehindMgr::RequestFlushAll()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (TableMap::value_type& table : tables)
+        table.second->RequestFlush();
+}
+
+void ElunaWriteBehindMgr::FlushAllAndWait()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (TableMap::value_type& table : tables)
+        table.second->FlushAndWait();
+}
@@ -0,0 +1,128 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_WRITE_BEHIND_H
+#define _ELUNA_WRITE_BEHIND_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "ElunaTransaction.h"
+#include "Database/Transaction.h"
+
+/*
+ * Rows of one table set by scripts, only the latest value of each column is kept until it is written.
+ *
+ * A row is identified by the values of its key columns. Setting a column of a row
+ *   that is still waiting replaces the value instead of adding another write.
+ *   Rows are written with INSERT ... ON DUPLICATE KEY UPDATE, so the key columns
+ *   must be the primary key or a unique key of the table.
+ *
+ * Only one write of a table runs at a time, so an older write can never finish
+ *   after a newer one and overwrite its values. The rows of a failed write wait
+ *   for the next one.
+ */
+class ElunaWriteBehindTable
+{
+public:
+    static const uint32 ROWS_PER_STATEMENT = 500;
+
+    ElunaWriteBehindTable(ElunaStatement::DatabaseType database, const std::string& name, const std::vector<std::string>& keyColumns);
+
+    ElunaStatement::DatabaseType GetDatabase() const { return database; }
+    const std::string& GetName() const { return name; }
+    const std::vector<std::string>& GetKeyColumns() const { return keyColumns; }
+    bool IsKeyColumn(const std::string& column) const;
+    uint32 GetDirtyCount() const;
+
+    // The key and the values must already be SQL literals, see ElunaStatement
+    void Set(std::vector<std::string>&& key, std::vector<std::pair<std::string, std::string>>&& values);
+
+    // Starts a write if one is due or was requested and the previous one has finished
+    void Update(bool due);
+    // Writes the waiting rows, or right after the write in progress has finished
+    void Flush();
+    // Writes the waiting rows with the next Update
+    void RequestFlush();
+    // Writes the waiting rows and returns once they are stored
+    void FlushAndWait();
+
+private:
+    struct Row
+    {
+        std::vector<std::string> key;
+        // Sorted by column, so rows setting the same columns share their statements
+        std::map<std::string, std::string> values;
+    };
+
+    // Returns true if the previous write has finished, writeLock must be held
+    bool IsWriteDone();
+    void Write(bool wait);
+    // Puts back the rows of a failed write, values set since then are kept
+    void Restore(std::unordered_map<std::string, Row>& failed);
+
+    ElunaStatement::DatabaseType database;
+    std::string name;
+    std::vector<std::string> keyColumns;
+
+    mutable std::mutex rowsLock;
+    // Rows by their key literals joined with '\0', which can't appear in a literal
+    std::unordered_map<std::string, Row> rows;
+
+    std::mutex writeLock;
+    std::optional<TransactionCallback> pendingWrite;
+    bool flushRequested;
+};
+
+/*
+ * The write-behind tables of the server, shared by all Lua states and kept across reloads.
+ *
+ * Waiting rows are written every Eluna.WriteBehindInterval milliseconds, on the
+ *   next update after a player logs out and on shutdown.
+ */
+class ElunaWriteBehindMgr
+{
+public:
+    static ElunaWriteBehindMgr& GetInstance();
+
+    // Returns the table, created on first use. Returns NULL if it was already created with other key columns
+    ElunaWriteBehindTable* GetTable(ElunaStatement::DatabaseType database, const std::string& name, const std::vector<std::string>& keyColumns);
+
+    void Update(uint32 diff);
+    // Logouts only request a flush, so the rows of all players logging out in one update share a write
+    void RequestFlushAll();
+    void FlushAllAndWait();
+
+private:
+    ElunaWriteBehindMgr() : timer(0) { }
+    ElunaWriteBehindMgr(const ElunaWriteBehindMgr&) = delete;
+    ElunaWriteBehindMgr& operator=(const ElunaWriteBehindMgr&) = delete;
+
+    typedef std::map<std::pair<ElunaStatement::DatabaseType, std::string>, std::unique_ptr<ElunaWriteBehindTable>> TableMap;
+
+    std::mutex lock;
+    // Tables are never removed, scripts keep pointers to them
+    TableMap tables;
+    uint32 timer;
+};
+
+/*
+ * What a script holds, the table itself outlives the Lua state.
+ */
+class ElunaWriteBehind
+{
+public:
+    explicit ElunaWriteBehind(ElunaWriteBehindTable* table) : table(table) { }
+
+    ElunaWriteBehindTable* GetTable() const { return table; }
+
+private:
+    ElunaWriteBehindTable* table;
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <thread>
 extern "C"
 {
@@ -10,45 +11,305 @@ extern "C"
 #include "libs/httplib.h"
 #include "HttpManager.h"
 #include "LuaEngine.h"
+#include "ElunaTemplate.h"
 
-HttpWorkItem::HttpWorkItem(int funcRef, const std::string& httpVerb, const std::string& url, const std::string& body, const std::string& contentType, const httplib::Headers& headers)
+HttpWorkItem::HttpWorkItem(int funcRef, const std::string& httpVerb, const std::string& url, const std::string& body, const std::string& contentType, const httplib::Headers& headers, uint8 mode)
     : funcRef(funcRef),
+    mode(mode),
     httpVerb(httpVerb),
     url(url),
     body(body),
     contentType(contentType),
-    headers(headers)
+    headers(headers),
+    revalidating(false)
 { }
 
-HttpResponse::HttpResponse(int funcRef, int statusCode, const std::string& body, const httplib::Headers& headers)
+HttpResponse::HttpResponse(int funcRef, int statusCode, const std::string& body, const httplib::Headers& headers, uint8 mode, bool last)
     : funcRef(funcRef),
     statusCode(statusCode),
     body(body),
-    headers(headers)
+    headers(headers),
+    mode(mode),
+    last(last)
 { }
 
-HttpManager::HttpManager()
-    : workQueue(16),
-    responseQueue(16),
+HttpManager::HttpManager(Eluna* _E)
+    : queueCapacity(0),
+    overflowPolicy(HTTP_OVERFLOW_REJECT),
+    overflowing(false),
     startedWorkerThread(false),
     cancelationToken(false),
     condVar(),
     condVarMutex(),
-    parseUrlRegex("^(([^:/?#]+):)?(//([^/?#]*))?([^?#]*)(\\?([^#]*))?(#(.*))?")
+    enqueuedCount(0),
+    droppedCount(0),
+    inFlightCount(0),
+    cacheHits(0),
+    cacheMisses(0),
+    coalescedCount(0),
+    E(_E)
 {
-    StartHttpWorker();
+    // The workers are started on the first request, most map states never make one
 }
 
 HttpManager::~HttpManager()
 {
     StopHttpWorker();
+    // Requests of a staged state that was never swapped in
+    ClearQueues();
+}
+
+bool HttpManager::PushRequest(HttpWorkItem* item)
+{
+    // A staged state can't run callbacks yet, its requests are sent once another state takes it over
+    if (E->IsStaged())
+    {
+        std::unique_lock<std::mutex> lock(condVarMutex);
+        workQueue.push_back(item);
+        return true;
+    }
+
+    if (!startedWorkerThread)
+        StartHttpWorker();
+
+    if (ElunaConfig::GetInstance().IsHttpCacheEnabled() && LookupCache(item))
+        return true;
+
+    HttpWorkItem* dropped = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(condVarMutex);
+        if (workQueue.size() >= queueCapacity)
+        {
+            if (!overflowing)
+            {
+                ELUNA_LOG_ERROR("[Eluna]: HTTP request queue is full ({} requests), dropping requests", queueCapacity);
+                overflowing = true;
+            }
+
+            if (overflowPolicy == HTTP_OVERFLOW_DROP_OLDEST && !workQueue.empty())
+            {
+                dropped = workQueue.front();
+                workQueue.pop_front();
+            }
+            else
+            {
+                dropped = item;
+                item = nullptr;
+            }
+        }
+        else if (workQueue.size() < queueCapacity / 2)
+        {
+            overflowing = false;
+        }
+
+        if (item)
+        {
+            workQueue.push_back(item);
+            ++enqueuedCount;
+            condVar.notify_one();
+        }
+    }
+
+    if (dropped)
+    {
+        ++droppedCount;
+        DropRequest(dropped);
+    }
+    return item != nullptr;
 }
 
-void HttpManager::PushRequest(HttpWorkItem* item)
+void HttpManager::TakeRequests(HttpManager& other)
+{
+    std::deque<HttpWorkItem*> items;
+    {
+        std::unique_lock<std::mutex> lock(other.condVarMutex);
+        items.swap(other.workQueue);
+    }
+
+    for (HttpWorkItem* item : items)
+    {
+        PushRequest(item);
+    }
+}
+
+void HttpManager::DropRequest(HttpWorkItem* item)
+{
+    // Requests coalesced into this one are dropped with it
+    std::vector<HttpCallback> callbacks;
+    if (!item->cacheKey.empty())
+    {
+        callbacks = TakeWaiters(item->cacheKey);
+    }
+    callbacks.emplace_back(item->funcRef, item->mode);
+
+    for (const HttpCallback& callback : callbacks)
+    {
+        if (overflowPolicy == HTTP_OVERFLOW_CALLBACK)
+        {
+            // Delivered with the other responses, the script is not called back from inside HttpRequest
+            std::lock_guard<std::mutex> lock(responseMutex);
+            responseQueue.push_back(new HttpResponse(callback.first, 0, "HTTP request queue is full", httplib::Headers(), callback.second));
+        }
+        else
+        {
+            luaL_unref(E->L, LUA_REGISTRYINDEX, callback.first);
+        }
+    }
+    delete item;
+}
+
+bool HttpManager::LookupCache(HttpWorkItem* item)
+{
+    // A streamed body is never held in full, so there is nothing to cache or share
+    if (item->httpVerb != "GET" || item->mode == HTTP_RESPONSE_STREAM)
+    {
+        return false;
+    }
+
+    // Headers are sorted, requests asking for different representations don't share a response
+    std::string key = item->url;
+    for (const auto& header : item->headers)
+    {
+        key += "\n" + header.first + ": " + header.second;
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    ResponseCache::const_iterator cached = responseCache.find(key);
+    if (cached != responseCache.end() && std::chrono::steady_clock::now() < cached->second.expires)
+    {
+        ++cacheHits;
+        std::lock_guard<std::mutex> responseLock(responseMutex);
+        responseQueue.push_back(new HttpResponse(item->funcRef, cached->second.statusCode, cached->second.body, cached->second.headers, item->mode));
+        delete item;
+        return true;
+    }
+
+    PendingRequests::iterator pending = pendingRequests.find(key);
+    if (pending != pendingRequests.end())
+    {
+        ++coalescedCount;
+        pending->second.emplace_back(item->funcRef, item->mode);
+        delete item;
+        return true;
+    }
+
+    ++cacheMisses;
+    pendingRequests[key];
+    item->cacheKey = key;
+
+    // A stale entry is kept if the server can confirm it is still current
+    if (cached != responseCache.end())
+    {
+        std::string etag = httplib::detail::get_header_value(cached->second.headers, "ETag", 0, "");
+        std::string lastModified = httplib::detail::get_header_value(cached->second.headers, "Last-Modified", 0, "");
+        if (!etag.empty())
+        {
+            item->headers.emplace("If-None-Match", etag);
+        }
+        if (!lastModified.empty())
+        {
+            item->headers.emplace("If-Modified-Since", lastModified);
+        }
+        item->revalidating = !etag.empty() || !lastModified.empty();
+    }
+    return false;
+}
+
+void HttpManager::StoreCache(const std::string& key, const httplib::Response& res)
+{
+    // Only plain successful responses, with the lifetime from Cache-Control or Eluna.HttpCacheTTL
+    if (res.status != 200)
+    {
+        return;
+    }
+
+    uint32 lifetime = ElunaConfig::GetInstance().GetHttpCacheTTL();
+    bool noCache = false;
+    auto directives = res.headers.equal_range("Cache-Control");
+    for (auto it = directives.first; it != directives.second; ++it)
+    {
+        std::string value = it->second;
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+        std::size_t start = 0;
+        while (start < value.length())
+        {
+            std::size_t end = std::min(value.find(',', start), value.length());
+            std::size_t first = value.find_first_not_of(' ', start);
+            std::string directive = first < end ? value.substr(first, value.find_last_not_of(' ', end - 1) + 1 - first) : "";
+            start = end + 1;
+
+            if (directive == "no-store")
+            {
+                return;
+            }
+            else if (directive == "no-cache")
+            {
+                noCache = true;
+            }
+            else if (directive.compare(0, 8, "max-age=") == 0)
+            {
+                lifetime = uint32(strtoul(directive.c_str() + 8, nullptr, 10));
+            }
+        }
+    }
+
+    if (noCache)
+    {
+        lifetime = 0;
+    }
+
+    // Without a lifetime the entry is only useful to revalidate
+    if (!lifetime && !res.has_header("ETag") && !res.has_header("Last-Modified"))
+    {
+        responseCache.erase(key);
+        return;
+    }
+
+    if (responseCache.size() >= MAX_CACHE_ENTRIES && responseCache.find(key) == responseCache.end())
+    {
+        // Drop the entry closest to expiring to make room
+        ResponseCache::iterator oldest = responseCache.begin();
+        for (ResponseCache::iterator it = responseCache.begin(); it != responseCache.end(); ++it)
+        {
+            if (it->second.expires < oldest->second.expires)
+            {
+                oldest = it;
+            }
+        }
+        responseCache.erase(oldest);
+    }
+
+    HttpCacheEntry& entry = responseCache[key];
+    entry.statusCode = res.status;
+    entry.body = res.body;
+    entry.headers = res.headers;
+    entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(lifetime);
+}
+
+std::vector<HttpManager::HttpCallback> HttpManager::TakeWaiters(const std::string& key)
+{
+    std::vector<HttpCallback> waiters;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    PendingRequests::iterator pending = pendingRequests.find(key);
+    if (pending != pendingRequests.end())
+    {
+        waiters.swap(pending->second);
+        pendingRequests.erase(pending);
+    }
+    return waiters;
+}
+
+uint32 HttpManager::GetQueuedCount()
 {
     std::unique_lock<std::mutex> lock(condVarMutex);
-    workQueue.push(item);
-    condVar.notify_one();
+    return uint32(workQueue.size());
+}
+
+uint32 HttpManager::GetResponseCount()
+{
+    std::unique_lock<std::mutex> lock(responseMutex);
+    return uint32(responseQueue.size());
 }
 
 void HttpManager::StartHttpWorker()
@@ -58,31 +319,40 @@ void HttpManager::StartHttpWorker()
     if (!startedWorkerThread)
     {
         cancelationToken.store(false);
-        workerThread = std::thread(&HttpManager::HttpWorkerThread, this);
+        queueCapacity = std::max<uint32>(1, ElunaConfig::GetInstance().GetHttpQueueSize());
+        overflowPolicy = ElunaConfig::GetInstance().GetHttpQueueOverflow();
+        overflowing = false;
+        uint32 workers = std::max<uint32>(1, ElunaConfig::GetInstance().GetHttpWorkers());
+        for (uint32 i = 0; i < workers; ++i)
+            workerThreads.emplace_back(&HttpManager::HttpWorkerThread, this);
         startedWorkerThread = true;
     }
 }
 
 void HttpManager::ClearQueues()
 {
-    while (workQueue.front())
     {
-        HttpWorkItem* item = *workQueue.front();
-        if (item != nullptr)
+        std::unique_lock<std::mutex> lock(condVarMutex);
+        for (HttpWorkItem* item : workQueue)
         {
             delete item;
         }
-        workQueue.pop();
+        workQueue.clear();
     }
 
-    while (responseQueue.front())
     {
-        HttpResponse* item = *responseQueue.front();
-        if (item != nullptr)
+        std::unique_lock<std::mutex> lock(responseMutex);
+        for (HttpResponse* item : responseQueue)
         {
             delete item;
         }
-        responseQueue.pop();
+        responseQueue.clear();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(cacheMutex);
+        responseCache.clear();
+        pendingRequests.clear();
     }
 }
 
@@ -93,88 +363,212 @@ void HttpManager::StopHttpWorker()
         return;
     }
 
-    cancelationToken.store(true);
-    condVar.notify_one();
-    workerThread.join();
+    {
+        std::unique_lock<std::mutex> lock(condVarMutex);
+        cancelationToken.store(true);
+    }
+    condVar.notify_all();
+    for (std::thread& worker : workerThreads)
+    {
+        worker.join();
+    }
+    workerThreads.clear();
     ClearQueues();
     startedWorkerThread = false;
 }
 
 void HttpManager::HttpWorkerThread()
 {
+    // Connections are kept per worker, a client is never used by two threads at once
+    ClientPool clients;
+
     while (true)
     {
+        HttpWorkItem* req;
         {
             std::unique_lock<std::mutex> lock(condVarMutex);
-            condVar.wait(lock, [&] { return workQueue.front() != nullptr || cancelationToken.load(); });
+            condVar.wait(lock, [&] { return !workQueue.empty() || cancelationToken.load(); });
+
+            if (cancelationToken.load())
+            {
+                break;
+            }
+
+            req = workQueue.front();
+            workQueue.pop_front();
         }
 
-        if (cancelationToken.load())
+        if (!req)
         {
-            break;
+            continue;
         }
-        if (!workQueue.front())
+
+        ++inFlightCount;
+        if (!ProcessRequest(clients, req))
         {
-            continue;
+            FailRequest(req);
         }
+        --inFlightCount;
+        delete req;
+    }
+}
 
-        HttpWorkItem* req = *workQueue.front();
-        workQueue.pop();
-        if (!req)
+bool HttpManager::ProcessRequest(ClientPool& clients, HttpWorkItem* req)
+{
+    try
+    {
+        std::string host;
+        std::string path;
+
+        if (!ParseUrl(req->url, host, path)) {
+            ELUNA_LOG_ERROR("[Eluna]: Could not parse URL {}", req->url);
+            return false;
+        }
+
+        httplib::Result res = DoRequest(GetClient(clients, host), req, path);
+        httplib::Error err = res.error();
+        if (err != httplib::Error::Success)
         {
-            continue;
+            ELUNA_LOG_ERROR("[Eluna]: HTTP request error: {}", httplib::to_string(err));
+            return false;
         }
 
-        try
+        if (res->status == 301)
         {
-            std::string host;
-            std::string path;
+            std::string location = res->get_header_value("Location");
 
-            if (!ParseUrl(req->url, host, path)) {
-                ELUNA_LOG_ERROR("[Eluna]: Could not parse URL {}", req->url);
-                continue;
+            if (!ParseUrl(location, host, path))
+            {
+                ELUNA_LOG_ERROR("[Eluna]: Could not parse URL after redirect: {}", location);
+                return false;
             }
-
-            httplib::Client cli(host);
-            cli.set_connection_timeout(0, 3000000); // 3 seconds
-            cli.set_read_timeout(5, 0); // 5 seconds
-            cli.set_write_timeout(5, 0); // 5 seconds
-
-            httplib::Result res = DoRequest(cli, req, path);
-            httplib::Error err = res.error();
-            if (err != httplib::Error::Success)
+            res = DoRequest(GetClient(clients, host), req, path);
+            if (!res)
             {
-                ELUNA_LOG_ERROR("[Eluna]: HTTP request error: {}", httplib::to_string(err));
-                continue;
+                ELUNA_LOG_ERROR("[Eluna]: HTTP request error after redirect: {}", httplib::to_string(res.error()));
+                return false;
             }
+        }
 
-            if (res->status == 301)
-            {
-                std::string location = res->get_header_value("Location");
-                std::string host;
-                std::string path;
+        CompleteRequest(req, *res);
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: HTTP request error: {}", ex.what());
+    }
+    return false;
+}
+
+void HttpManager::FailRequest(HttpWorkItem* req)
+{
+    // Called with status 0 like dropped requests, so the scripts hear back and the callbacks are released.
+    // A stream gets its final call, the requests coalesced into this one fail with it.
+    std::vector<HttpCallback> callbacks;
+    if (!req->cacheKey.empty())
+    {
+        callbacks = TakeWaiters(req->cacheKey);
+    }
+    callbacks.emplace_back(req->funcRef, req->mode);
 
-                if (!ParseUrl(location, host, path))
+    std::lock_guard<std::mutex> lock(responseMutex);
+    for (const HttpCallback& callback : callbacks)
+    {
+        responseQueue.push_back(new HttpResponse(callback.first, 0, "HTTP request failed", httplib::Headers(), callback.second));
+    }
+}
+
+void HttpManager::CompleteRequest(HttpWorkItem* req, httplib::Response& res)
+{
+    int statusCode = res.status;
+    const std::string* body = &res.body;
+    const httplib::Headers* headers = &res.headers;
+    std::vector<HttpCallback> callbacks;
+
+    std::unique_lock<std::mutex> lock(cacheMutex, std::defer_lock);
+    if (!req->cacheKey.empty())
+    {
+        lock.lock();
+        ResponseCache::iterator cached = responseCache.find(req->cacheKey);
+        if (req->revalidating && res.status == 304 && cached != responseCache.end())
+        {
+            // Still current, the cached response is served with the lifetime given now
+            httplib::Response refreshed;
+            refreshed.status = cached->second.statusCode;
+            refreshed.body = cached->second.body;
+            refreshed.headers = cached->second.headers;
+            for (const char* name : { "Cache-Control", "ETag", "Last-Modified" })
+            {
+                if (!res.has_header(name))
                 {
-                    ELUNA_LOG_ERROR("[Eluna]: Could not parse URL after redirect: {}", location);
                     continue;
                 }
-                httplib::Client cli2(host);
-                cli2.set_connection_timeout(0, 3000000); // 3 seconds
-                cli2.set_read_timeout(5, 0); // 5 seconds
-                cli2.set_write_timeout(5, 0); // 5 seconds
-                res = DoRequest(cli2, req, path);
+                refreshed.headers.erase(name);
+                auto values = res.headers.equal_range(name);
+                refreshed.headers.insert(values.first, values.second);
             }
+            StoreCache(req->cacheKey, refreshed);
+        }
+        else
+        {
+            StoreCache(req->cacheKey, res);
+        }
 
-            responseQueue.push(new HttpResponse(req->funcRef, res->status, res->body, res->headers));
+        cached = responseCache.find(req->cacheKey);
+        if (req->revalidating && res.status == 304 && cached != responseCache.end())
+        {
+            statusCode = cached->second.statusCode;
+            body = &cached->second.body;
+            headers = &cached->second.headers;
         }
-        catch (const std::exception& ex)
+
+        PendingRequests::iterator pending = pendingRequests.find(req->cacheKey);
+        if (pending != pendingRequests.end())
         {
-            ELUNA_LOG_ERROR("[Eluna]: HTTP request error: {}", ex.what());
+            callbacks.swap(pending->second);
+            pendingRequests.erase(pending);
         }
+        // Answered, a new request for the key may already be pending
+        req->cacheKey.clear();
+    }
+    std::lock_guard<std::mutex> responseLock(responseMutex);
+    for (const HttpCallback& callback : callbacks)
+    {
+        responseQueue.push_back(new HttpResponse(callback.first, statusCode, *body, *headers, callback.second));
+    }
 
-        delete req;
+    // The request's own callback takes the body instead of a copy when it isn't the cached one,
+    // the rest of a streamed body goes with this final call
+    HttpResponse* response = new HttpResponse(req->funcRef, statusCode, std::string(), *headers, req->mode);
+    if (body == &res.body)
+    {
+        response->body.swap(res.body);
+    }
+    else
+    {
+        response->body = *body;
     }
+    responseQueue.push_back(response);
+}
+
+httplib::Client& HttpManager::GetClient(ClientPool& clients, const std::string& host)
+{
+    // Scripts building URLs from player input could otherwise keep a socket open per host forever
+    if (clients.size() >= 64 && clients.find(host) == clients.end())
+    {
+        clients.clear();
+    }
+
+    std::unique_ptr<httplib::Client>& client = clients[host];
+    if (!client)
+    {
+        client.reset(new httplib::Client(host));
+        client->set_keep_alive(true);
+        client->set_connection_timeout(0, 3000000); // 3 seconds
+        client->set_read_timeout(5, 0); // 5 seconds
+        client->set_write_timeout(5, 0); // 5 seconds
+    }
+    return *client;
 }
 
 httplib::Result HttpManager::DoRequest(httplib::Client& client, HttpWorkItem* req, const std::string& urlPath)
@@ -182,6 +576,11 @@ httplib::Result HttpManager::DoRequest(httplib::Client& client, HttpWorkItem* re
     const char* path = urlPath.c_str();
     if (req->httpVerb == "GET")
     {
+        // Other verbs in stream mode get their whole body in the final call
+        if (req->mode == HTTP_RESPONSE_STREAM)
+        {
+            return DoStreamRequest(client, req, urlPath);
+        }
         return client.Get(path, req->headers);
     }
     if (req->httpVerb == "HEAD")
@@ -213,63 +612,166 @@ httplib::Result HttpManager::DoRequest(httplib::Client& client, HttpWorkItem* re
     return client.Get(path, req->headers);
 }
 
+httplib::Result HttpManager::DoStreamRequest(httplib::Client& client, HttpWorkItem* req, const std::string& path)
+{
+    int statusCode = 0;
+    httplib::Headers headers;
+    std::string chunk;
+
+    httplib::Result res = client.Get(path.c_str(), req->headers,
+        [&](const httplib::Response& response)
+        {
+            statusCode = response.status;
+            headers = response.headers;
+            return true;
+        },
+        [&](const char* data, size_t length)
+        {
+            // The body of a redirect is not for the script, ProcessRequest follows it
+            if (statusCode == 301)
+            {
+                return true;
+            }
+
+            chunk.append(data, length);
+            if (chunk.size() >= STREAM_CHUNK_SIZE)
+            {
+                PushChunk(req, statusCode, chunk, headers);
+            }
+            return !cancelationToken.load();
+        });
+
+    // The rest of the body is handed to the callback with the final call
+    if (res)
+    {
+        res->body.swap(chunk);
+    }
+    return res;
+}
+
+void HttpManager::PushChunk(HttpWorkItem* req, int statusCode, std::string& chunk, const httplib::Headers& headers)
+{
+    HttpResponse* response = new HttpResponse(req->funcRef, statusCode, std::string(), headers, HTTP_RESPONSE_STREAM, false);
+    response->body.swap(chunk);
+
+    std::lock_guard<std::mutex> lock(responseMutex);
+    responseQueue.push_back(response);
+}
+
 bool HttpManager::ParseUrl(const std::string& url, std::string& host, std::string& path)
 {
-    std::smatch matches;
+    // scheme://authority/path?query#fragment, split in one pass. The fragment is never sent.
+    std::size_t pos = 0;
+    std::string scheme;
+    std::size_t schemeEnd = url.find_first_of(":/?#");
+    if (schemeEnd != std::string::npos && schemeEnd > 0 && url[schemeEnd] == ':')
+    {
+        scheme = url.substr(0, schemeEnd);
+        pos = schemeEnd + 1;
+    }
+
+    std::string authority;
+    if (url.compare(pos, 2, "//") == 0)
+    {
+        std::size_t authorityEnd = std::min(url.find_first_of("/?#", pos + 2), url.length());
+        authority = url.substr(pos + 2, authorityEnd - pos - 2);
+        pos = authorityEnd;
+    }
 
-    if (!std::regex_search(url, matches, parseUrlRegex))
+    if (scheme.empty() || authority.empty())
     {
         return false;
     }
 
-    std::string scheme = matches[2];
-    std::string authority = matches[4];
-    std::string query = matches[7];
-    host = scheme + "://" + authority;
-    path = matches[5];
+    std::size_t pathEnd = std::min(url.find_first_of("?#", pos), url.length());
+    path = url.substr(pos, pathEnd - pos);
     if (path.empty())
     {
         path = "/";
     }
-    path += (query.empty() ? "" : "?") + query;
 
+    if (pathEnd < url.length() && url[pathEnd] == '?')
+    {
+        std::size_t queryEnd = std::min(url.find('#', pathEnd), url.length());
+        if (queryEnd - pathEnd > 1)
+        {
+            path += url.substr(pathEnd, queryEnd - pathEnd);
+        }
+    }
+
+    host = scheme + "://" + authority;
     return true;
 }
 
-void HttpManager::HandleHttpResponses()
+void HttpManager::HandleHttpResponses(ElunaUtil::Deadline deadline)
 {
-    while (!responseQueue.empty())
+    while (true)
     {
-        HttpResponse* res = *responseQueue.front();
-        responseQueue.pop();
+        HttpResponse* res;
+        {
+            std::unique_lock<std::mutex> lock(responseMutex);
+            if (responseQueue.empty())
+            {
+                break;
+            }
+            res = responseQueue.front();
+            responseQueue.pop_front();
+        }
 
         if (res == nullptr)
         {
             continue;
         }
 
-        LOCK_ELUNA;
+        Eluna::Guard guard(E->GetStateLock());
+
+        lua_State* L = E->L;
 
-        lua_State* L = Eluna::GEluna->L;
+        int funcRef = res->funcRef;
+        bool last = res->last;
 
         // Get function
-        lua_rawgeti(L, LUA_REGISTRYINDEX, res->funcRef);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
 
         // Push parameters
         Eluna::Push(L, res->statusCode);
-        Eluna::Push(L, res->body);
-        lua_newtable(L);
-        for (const auto& item : res->headers) {
-            Eluna::Push(L, item.first);
-            Eluna::Push(L, item.second);
-            lua_settable(L, -3);
+        if (res->mode == HTTP_RESPONSE_STRINGS)
+        {
+            Eluna::Push(L, res->body);
+            lua_newtable(L);
+            for (const auto& item : res->headers) {
+                Eluna::Push(L, item.first);
+                Eluna::Push(L, item.second);
+                lua_settable(L, -3);
+            }
+
+            // Call function
+            E->ExecuteCall(3, 0);
+            delete res;
         }
+        else
+        {
+            // Owned by Lua from here on, the body and headers are converted only when asked for
+            uint8 mode = res->mode;
+            Eluna::Push(L, res);
+            if (mode == HTTP_RESPONSE_STREAM)
+            {
+                Eluna::Push(L, last);
+            }
 
-        // Call function
-        Eluna::GEluna->ExecuteCall(3, 0);
+            // Call function
+            E->ExecuteCall(mode == HTTP_RESPONSE_STREAM ? 3 : 2, 0);
+        }
 
-        luaL_unref(L, LUA_REGISTRYINDEX, res->funcRef);
+        // A streamed body calls back once per chunk
+        if (last)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, funcRef);
+        }
 
-        delete res;
+        if (ElunaUtil::IsPast(deadline))
+        {
+            break;
+        }
     }
 }
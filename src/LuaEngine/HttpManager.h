@@ -1,61 +1,162 @@
 #ifndef ELUNA_HTTP_MANAGER_H
 #define ELUNA_HTTP_MANAGER_H
 
-#include <regex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "libs/httplib.h"
-#include "libs/rigtorp/SPSCQueue.h"
+#include "Common.h"
+#include "ElunaUtility.h"
+
+class Eluna;
+
+// How a response is handed to the callback of HttpRequest
+enum HttpResponseMode
+{
+    HTTP_RESPONSE_STRINGS       = 0,    // (status, body, headers) as a string and a table
+    HTTP_RESPONSE_LAZY          = 1,    // (status, response) as HttpResponse, converted on access
+    HTTP_RESPONSE_STREAM        = 2,    // (status, response, last) for every chunk of the body
+};
 
 struct HttpWorkItem
 {
 public:
-    HttpWorkItem(int funcRef, const std::string& httpVerb, const std::string& url, const std::string& body, const std::string &contentType, const httplib::Headers& headers);
+    HttpWorkItem(int funcRef, const std::string& httpVerb, const std::string& url, const std::string& body, const std::string &contentType, const httplib::Headers& headers, uint8 mode = HTTP_RESPONSE_STRINGS);
 
     int funcRef;
+    uint8 mode;
     std::string httpVerb;
     std::string url;
     std::string body;
     std::string contentType;
     httplib::Headers headers;
+    // Set for GETs going through the response cache, requests with the same key share the response
+    std::string cacheKey;
+    // The request carries the validators of a stale cache entry
+    bool revalidating;
+};
+
+struct HttpCacheEntry
+{
+    int statusCode;
+    std::string body;
+    httplib::Headers headers;
+    std::chrono::steady_clock::time_point expires;
 };
 
 struct HttpResponse
 {
 public:
-    HttpResponse(int funcRef, int statusCode, const std::string& body, const httplib::Headers& headers);
+    HttpResponse(int funcRef, int statusCode, const std::string& body, const httplib::Headers& headers, uint8 mode = HTTP_RESPONSE_STRINGS, bool last = true);
 
     int funcRef;
     int statusCode;
     std::string body;
     httplib::Headers headers;
+    uint8 mode;
+    // False for the chunks of a streamed body before the final one
+    bool last;
 };
 
 
+// What PushRequest does when the request queue is full, set by Eluna.HttpQueueOverflow
+enum HttpOverflowPolicy
+{
+    HTTP_OVERFLOW_REJECT        = 0,    // The new request is not queued
+    HTTP_OVERFLOW_DROP_OLDEST   = 1,    // The oldest queued request is dropped to make room
+    HTTP_OVERFLOW_CALLBACK      = 2,    // The new request is not queued, its callback gets status 0
+};
+
 class HttpManager
 {
 public:
-    HttpManager();
+    HttpManager(Eluna* _E);
     ~HttpManager();
 
     void StartHttpWorker();
     void StopHttpWorker();
-    void PushRequest(HttpWorkItem* item);
-    void HandleHttpResponses();
+    // Never blocks, returns false if the request was not queued
+    bool PushRequest(HttpWorkItem* item);
+    // Sends the requests a staged state queued while it was loading, their callbacks run on this state
+    void TakeRequests(HttpManager& other);
+    // Responses left when the deadline has passed are handled by the next call
+    void HandleHttpResponses(ElunaUtil::Deadline deadline = ElunaUtil::NO_DEADLINE);
+
+    uint64 GetEnqueuedCount() const { return enqueuedCount.load(); }
+    uint64 GetDroppedCount() const { return droppedCount.load(); }
+    uint32 GetInFlightCount() const { return inFlightCount.load(); }
+    uint32 GetQueuedCount();
+    // Responses waiting for their callback to run
+    uint32 GetResponseCount();
+    uint64 GetCacheHitCount() const { return cacheHits.load(); }
+    uint64 GetCacheMissCount() const { return cacheMisses.load(); }
+    uint64 GetCoalescedCount() const { return coalescedCount.load(); }
 
 private:
+    // scheme://host:port -> client with a kept alive connection, owned by a single worker
+    typedef std::unordered_map<std::string, std::unique_ptr<httplib::Client>> ClientPool;
+    typedef std::unordered_map<std::string, HttpCacheEntry> ResponseCache;
+    // Callback and response mode of a request
+    typedef std::pair<int, uint8> HttpCallback;
+    // Cache key -> callbacks of the requests waiting on the one being run
+    typedef std::unordered_map<std::string, std::vector<HttpCallback>> PendingRequests;
+
+    static const size_t MAX_CACHE_ENTRIES = 256;
+    // Bytes of a streamed body gathered before they are handed to the callback
+    static const size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
     void ClearQueues();
+    // Called on the thread of the Lua state for a request that is not going to run
+    void DropRequest(HttpWorkItem* item);
+    // Answers the request from the cache or joins it to an identical one, returns true if it is handled
+    bool LookupCache(HttpWorkItem* item);
+    void StoreCache(const std::string& key, const httplib::Response& res);
+    std::vector<HttpCallback> TakeWaiters(const std::string& key);
     void HttpWorkerThread();
-    bool ParseUrl(const std::string& url, std::string& host, std::string& path);
+    // Returns false if the request failed without a response
+    bool ProcessRequest(ClientPool& clients, HttpWorkItem* req);
+    void FailRequest(HttpWorkItem* req);
+    // Queues the response for the request and every request coalesced into it
+    void CompleteRequest(HttpWorkItem* req, httplib::Response& res);
+    httplib::Client& GetClient(ClientPool& clients, const std::string& host);
+    static bool ParseUrl(const std::string& url, std::string& host, std::string& path);
     httplib::Result DoRequest(httplib::Client& client, HttpWorkItem* req, const std::string& path);
+    // Runs a GET handing the body to the callback in chunks as it arrives, the final one goes through CompleteRequest
+    httplib::Result DoStreamRequest(httplib::Client& client, HttpWorkItem* req, const std::string& path);
+    void PushChunk(HttpWorkItem* req, int statusCode, std::string& chunk, const httplib::Headers& headers);
 
-    rigtorp::SPSCQueue<HttpWorkItem*> workQueue;
-    rigtorp::SPSCQueue<HttpResponse*> responseQueue;
-    std::thread workerThread;
+    // Guarded by condVarMutex, workers take requests in order
+    std::deque<HttpWorkItem*> workQueue;
+    size_t queueCapacity;
+    uint32 overflowPolicy;
+    // Set once the queue is full, so a burst logs a single error
+    bool overflowing;
+    // Guarded by responseMutex, a full queue never blocks a worker
+    std::deque<HttpResponse*> responseQueue;
+    std::mutex responseMutex;
+    std::vector<std::thread> workerThreads;
     bool startedWorkerThread;
     std::atomic_bool cancelationToken;
     std::condition_variable condVar;
     std::mutex condVarMutex;
-    std::regex parseUrlRegex;
+    // Accepted and dropped since the workers started, in flight is being run by a worker right now
+    std::atomic<uint64> enqueuedCount;
+    std::atomic<uint64> droppedCount;
+    std::atomic<uint32> inFlightCount;
+    // Guarded by cacheMutex
+    ResponseCache responseCache;
+    PendingRequests pendingRequests;
+    std::mutex cacheMutex;
+    std::atomic<uint64> cacheHits;
+    std::atomic<uint64> cacheMisses;
+    std::atomic<uint64> coalescedCount;
+    Eluna* E;
 };
 
 #endif // #ifndef ELUNA_HTTP_MANAGER_H
@@ -15,6 +15,7 @@
 #include "ElunaUtility.h"
 #include "ElunaCreatureAI.h"
 #include "ElunaInstanceAI.h"
+#include "ElunaStatement.h"
 
 #if AC_PLATFORM == AC_PLATFORM_WINDOWS
 #define ELUNA_WINDOWS
@@ -25,11 +26,18 @@
 #define USING_BOOST
 
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <iterator>
+#include <thread>
 #include <vector>
 #include <ctime>
 #include <sys/stat.h>
 #include <unordered_map>
+#include <unordered_set>
 
 extern "C"
 {
@@ -46,16 +54,25 @@ Eluna::ScriptList Eluna::lua_extensions;
 std::string Eluna::lua_folderpath;
 std::string Eluna::lua_requirepath;
 std::string Eluna::lua_requirecpath;
+std::vector<std::string> Eluna::lua_scriptfolders;
+std::shared_ptr<const Eluna::ModuleIndex> Eluna::lua_modules;
 Eluna* Eluna::GEluna = NULL;
 bool Eluna::reload = false;
 bool Eluna::initialized = false;
+bool Eluna::multistate = false;
 Eluna::LockType Eluna::lock;
+Eluna::MapStateList Eluna::mapStates;
+std::shared_mutex Eluna::mapStatesLock;
 std::unique_ptr<ElunaFileWatcher> Eluna::fileWatcher;
+std::future<Eluna*> Eluna::stagedReload;
 
 // Global bytecode cache that survives Eluna reloads
 static std::unordered_map<std::string, GlobalCacheEntry> globalBytecodeCache;
-static std::unordered_map<std::string, std::time_t> timestampCache;
+static std::unordered_map<std::string, uint64> timestampCache;
 static std::mutex globalCacheMutex;
+// Scripts some thread is compiling right now, guarded by globalCacheMutex
+static std::unordered_set<std::string> compilingScripts;
+static std::condition_variable compileFinished;
 
 extern void RegisterFunctions(Eluna* E);
 
@@ -74,20 +91,33 @@ void Eluna::Initialize()
     // This is checked on Eluna creation
     initialized = true;
 
+    // Read once, map states can not be created or dropped on config reload
+    multistate = ElunaConfig::GetInstance().IsMultiStateEnabled();
+    if (multistate)
+        ELUNA_LOG_INFO("[Eluna]: Multistate enabled, maps will use their own Lua states");
+
+    if (ElunaConfig::GetInstance().IsByteCodeCacheEnabled())
+        ElunaBytecodeCache::SetDirectory(std::string(ElunaConfig::GetInstance().GetBytecodeCachePath()));
+
     // Create global eluna
     GEluna = new Eluna();
 
     // Start file watcher if enabled
     if (ElunaConfig::GetInstance().IsAutoReloadEnabled())
     {
-        uint32 watchInterval = eConfigMgr->GetOption<uint32>("Eluna.AutoReloadInterval", 1);
+        uint32 watchInterval = ElunaConfig::GetInstance().GetAutoReloadInterval();
+        uint32 debounce = ElunaConfig::GetInstance().GetAutoReloadDebounce();
         fileWatcher = std::make_unique<ElunaFileWatcher>();
-        fileWatcher->StartWatching(lua_folderpath, watchInterval);
+        fileWatcher->StartWatching(lua_folderpath, watchInterval, debounce);
     }
 }
 
 void Eluna::Uninitialize()
 {
+    // Wait for an async reload still building its state, it takes the lock to read the script lists
+    if (stagedReload.valid())
+        delete stagedReload.get();
+
     LOCK_ELUNA;
     ASSERT(IsInitialized());
 
@@ -98,6 +128,14 @@ void Eluna::Uninitialize()
         fileWatcher.reset();
     }
 
+    // Maps should have destroyed their states already, clean up any left
+    {
+        std::unique_lock<std::shared_mutex> guard(mapStatesLock);
+        for (MapStateList::const_iterator it = mapStates.begin(); it != mapStates.end(); ++it)
+            delete it->second;
+        mapStates.clear();
+    }
+
     delete GEluna;
     GEluna = NULL;
 
@@ -131,8 +169,10 @@ void Eluna::LoadScriptPaths()
     // clear all cache variables
     lua_requirepath.clear();
     lua_requirecpath.clear();
+    lua_scriptfolders.clear();
 
     GetScripts(lua_folderpath);
+    BuildModuleIndex();
 
     // append our custom require paths and cpaths if the config variables are not empty
     if (!lua_path_extra.empty())
@@ -153,39 +193,248 @@ void Eluna::LoadScriptPaths()
 
 void Eluna::_ReloadEluna()
 {
+    // Reload runs on the world update, map states are not in use at this point
+    std::vector<Eluna*> states;
+    states.push_back(sEluna);
+    {
+        std::shared_lock<std::shared_mutex> guard(mapStatesLock);
+        for (MapStateList::const_iterator it = mapStates.begin(); it != mapStates.end(); ++it)
+            states.push_back(it->second);
+    }
+
+    // Lock order is map state -> world state, so the map states are locked before the world lock
+    std::vector<std::unique_lock<LockType>> mapGuards;
+    for (size_t i = 1; i < states.size(); ++i)
+        mapGuards.emplace_back(states[i]->GetStateLock());
+
     LOCK_ELUNA;
     ASSERT(IsInitialized());
 
+    if (!reload)
+        return;
+
+    // Reloads requested while a state is being built start once it has been swapped in
+    if (stagedReload.valid())
+        return;
+
     if (eConfigMgr->GetOption<bool>("Eluna.PlayerAnnounceReload", false))
         eWorldSessionMgr->SendServerMessage(SERVER_MSG_STRING, "Reloading Eluna...");
     else
         ChatHandler(nullptr).SendGMText(SERVER_MSG_STRING, "Reloading Eluna...");
 
-    // Remove all timed events
-    sEluna->eventMgr->SetStates(LUAEVENT_STATE_ERASE);
+    // The states stay open, only changed scripts and the ones requiring them run again
+    if (ElunaConfig::GetInstance().IsIncrementalReloadEnabled() && ElunaConfig::GetInstance().IsElunaEnabled())
+    {
+        ReloadChangedScripts();
+        reload = false;
+        return;
+    }
+
+    // Map states would all need a new state as well, those are always reloaded in place
+    if (!multistate && ElunaConfig::GetInstance().IsAsyncReloadEnabled() && ElunaConfig::GetInstance().IsElunaEnabled())
+    {
+        // The script lists are shared by all states, so they are only rewritten on the world thread.
+        // Other reloads wait for the staged state, nothing changes them while it is built.
+        LoadScriptPaths();
+        stagedReload = std::async(std::launch::async, &Eluna::BuildStagedState);
+        reload = false;
+        return;
+    }
+
+    for (Eluna* E : states)
+    {
+        Guard guard(E->GetStateLock());
+
+        // Remove all timed events
+        E->eventMgr->SetStates(LUAEVENT_STATE_ERASE);
 
-    // Close lua
-    sEluna->CloseLua();
+        // Close lua
+        E->CloseLua();
+    }
 
     // Reload script paths
     LoadScriptPaths();
 
-    // Open new lua and libaraies
-    sEluna->OpenLua();
+    for (Eluna* E : states)
+    {
+        Guard guard(E->GetStateLock());
+
+        // Open new lua and libaraies
+        E->OpenLua();
 
-    // Run scripts from laoded paths
-    sEluna->RunScripts();
+        // Run scripts from laoded paths
+        E->RunScripts();
+    }
 
     reload = false;
 }
 
-Eluna::Eluna() :
+Eluna* Eluna::BuildStagedState()
+{
+    uint32 oldMSTime = ElunaUtil::GetCurrTime();
+
+    Eluna* E = new Eluna(NULL, true);
+    if (!E->HasLuaState() || !E->RunScripts())
+    {
+        delete E;
+        return NULL;
+    }
+
+    ELUNA_LOG_INFO("[Eluna]: Built new Lua state in {} ms", ElunaUtil::GetTimeDiff(oldMSTime));
+    return E;
+}
+
+void Eluna::UpdateAsyncReload()
+{
+    if (!stagedReload.valid() || stagedReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    Eluna* staged = stagedReload.get();
+    if (!staged)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Reload failed, keeping the current Lua state");
+        ChatHandler(nullptr).SendGMText(SERVER_MSG_STRING, "Eluna reload failed, see the server log");
+        return;
+    }
+
+    Guard guard(GEluna->GetStateLock());
+    GEluna->AdoptState(staged);
+    delete staged;
+}
+
+void Eluna::AdoptState(Eluna* staged)
+{
+    // Same as a reload in place, the current timed events and Lua state go first
+    eventMgr->SetStates(LUAEVENT_STATE_ERASE);
+    CloseLua();
+
+    std::swap(L, staged->L);
+    std::swap(callstackid, staged->callstackid);
+    lua_pushlightuserdata(L, this);
+    lua_setfield(L, LUA_REGISTRYINDEX, ELUNA_STATE_PTR);
+
+    std::swap(ServerEventBindings, staged->ServerEventBindings);
+    std::swap(PlayerEventBindings, staged->PlayerEventBindings);
+    std::swap(GuildEventBindings, staged->GuildEventBindings);
+    std::swap(GroupEventBindings, staged->GroupEventBindings);
+    std::swap(VehicleEventBindings, staged->VehicleEventBindings);
+    std::swap(BGEventBindings, staged->BGEventBindings);
+    std::swap(TicketEventBindings, staged->TicketEventBindings);
+    std::swap(AllCreatureEventBindings, staged->AllCreatureEventBindings);
+
+    std::swap(PacketEventBindings, staged->PacketEventBindings);
+    std::swap(CreatureEventBindings, staged->CreatureEventBindings);
+    std::swap(CreatureGossipBindings, staged->CreatureGossipBindings);
+    std::swap(GameObjectEventBindings, staged->GameObjectEventBindings);
+    std::swap(GameObjectGossipBindings, staged->GameObjectGossipBindings);
+    std::swap(ItemEventBindings, staged->ItemEventBindings);
+    std::swap(ItemGossipBindings, staged->ItemGossipBindings);
+    std::swap(PlayerGossipBindings, staged->PlayerGossipBindings);
+    std::swap(MapEventBindings, staged->MapEventBindings);
+    std::swap(InstanceEventBindings, staged->InstanceEventBindings);
+    std::swap(SpellEventBindings, staged->SpellEventBindings);
+
+    std::swap(CreatureUniqueBindings, staged->CreatureUniqueBindings);
+
+    std::swap(instanceDataRefs, staged->instanceDataRefs);
+    std::swap(continentDataRefs, staged->continentDataRefs);
+    std::swap(scriptModules, staged->scriptModules);
+    std::swap(moduleIndex, staged->moduleIndex);
+
+    // Timed events created while loading move over, the erased ones go to the staged state
+    eventMgr->SwapGlobalEvents(staged->eventMgr);
+
+    // So do queries and HTTP requests started while loading, the staged state never ran their callbacks
+    queryProcessor.TakeCallbacks(staged->queryProcessor);
+    httpManager.TakeRequests(staged->httpManager);
+
+    ELUNA_LOG_INFO("[Eluna]: Swapped in the reloaded Lua state");
+    OnLuaStateOpen();
+}
+
+Eluna* Eluna::GetMapState(Map* map)
+{
+    if (!multistate || !map || !IsInitialized())
+        return GEluna;
+
+    {
+        std::shared_lock<std::shared_mutex> guard(mapStatesLock);
+        MapStateList::const_iterator it = mapStates.find(map);
+        if (it != mapStates.end())
+            return it->second;
+    }
+
+    // Create the state outside of the list lock, running the scripts takes a while
+    Eluna* E = new Eluna(map);
+    E->RunScripts();
+
+    std::unique_lock<std::shared_mutex> guard(mapStatesLock);
+    std::pair<MapStateList::iterator, bool> result = mapStates.emplace(map, E);
+    if (!result.second)
+    {
+        // Another thread created the state first
+        guard.unlock();
+        delete E;
+    }
+    return result.first->second;
+}
+
+Eluna* Eluna::FindMapState(Map* map)
+{
+    if (!multistate || !map || !IsInitialized())
+        return GEluna;
+
+    std::shared_lock<std::shared_mutex> guard(mapStatesLock);
+    MapStateList::const_iterator it = mapStates.find(map);
+    return it != mapStates.end() ? it->second : NULL;
+}
+
+void Eluna::DestroyMapState(Map* map)
+{
+    if (!multistate)
+        return;
+
+    Eluna* E = NULL;
+    {
+        std::unique_lock<std::shared_mutex> guard(mapStatesLock);
+        MapStateList::iterator it = mapStates.find(map);
+        if (it == mapStates.end())
+            return;
+        E = it->second;
+        mapStates.erase(it);
+    }
+    delete E;
+}
+
+Eluna* Eluna::GetStateFor(WorldObject const* obj)
+{
+    // Player hooks always run on the world state
+    if (!multistate || obj->GetTypeId() == TYPEID_PLAYER)
+        return GEluna;
+    return GetMapState(obj->FindMap());
+}
+
+int32 Eluna::GetBoundMapId() const
+{
+    return boundMap ? int32(boundMap->GetId()) : -1;
+}
+
+uint32 Eluna::GetBoundInstanceId() const
+{
+    return boundMap ? boundMap->GetInstanceId() : 0;
+}
+
+Eluna::Eluna(Map* map, bool isStaged) :
+boundMap(map),
+staged(isStaged),
+callstackid(new uint64(2)),
 event_level(0),
 push_counter(0),
+callbackRound(0),
 
 L(NULL),
 eventMgr(NULL),
-httpManager(),
+httpManager(this),
 queryProcessor(),
 
 ServerEventBindings(NULL),
@@ -215,11 +464,8 @@ CreatureUniqueBindings(NULL)
 
     OpenLua();
 
-    // Replace this with map insert if making multithread version
-
-    // Set event manager. Must be after setting sEluna
-    // on multithread have a map of state pointers and here insert this pointer to the map and then save a pointer of that pointer to the EventMgr
-    eventMgr = new EventMgr(&Eluna::GEluna);
+    // Set event manager
+    eventMgr = new EventMgr(this);
 }
 
 Eluna::~Eluna()
@@ -234,9 +480,12 @@ Eluna::~Eluna()
 
 void Eluna::CloseLua()
 {
-    OnLuaStateClose();
+    // A staged state never ran its open hooks
+    if (L && !staged)
+        OnLuaStateClose();
 
     DestroyBindStores();
+    queryProcessor.Clear();
 
     // Must close lua state after deleting stores and mgr
     if (L)
@@ -245,6 +494,7 @@ void Eluna::CloseLua()
 
     instanceDataRefs.clear();
     continentDataRefs.clear();
+    scriptModules.Clear();
 }
 
 void Eluna::OpenLua()
@@ -267,6 +517,11 @@ void Eluna::OpenLua()
 
     // open additional lua libraries
 
+    // Track which scripts require which, reloading a script runs the scripts requiring it again
+    lua_getglobal(L, "require");
+    lua_pushcclosure(L, &ElunaScriptModules::Require, 1);
+    lua_setglobal(L, "require");
+
     // Register methods and functions
     RegisterFunctions(this);
 
@@ -285,7 +540,20 @@ void Eluna::OpenLua()
         lua_getfield(L, -1, "searchers");
     }
 
-    lua_pop(L, 1);
+    // Scripts are found right after package.preload, before the searchers probing package.path and cpath
+    moduleIndex = lua_modules;
+    if (lua_istable(L, -1))
+    {
+        for (int i = int(lua_rawlen(L, -1)); i >= 2; --i)
+        {
+            lua_rawgeti(L, -1, i);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_pushcfunction(L, &Eluna::SearchModule);
+        lua_rawseti(L, -2, 2);
+    }
+
+    lua_pop(L, 2);
 }
 
 void Eluna::CreateBindStores()
@@ -323,6 +591,7 @@ void Eluna::DestroyBindStores()
     delete GuildEventBindings;
     delete GroupEventBindings;
     delete VehicleEventBindings;
+    delete TicketEventBindings;
     delete AllCreatureEventBindings;
 
     delete PacketEventBindings;
@@ -345,6 +614,7 @@ void Eluna::DestroyBindStores()
     GuildEventBindings = NULL;
     GroupEventBindings = NULL;
     VehicleEventBindings = NULL;
+    TicketEventBindings = NULL;
     AllCreatureEventBindings = NULL;
 
     PacketEventBindings = NULL;
@@ -384,6 +654,7 @@ void Eluna::AddScriptPath(std::string filename, const std::string& fullpath)
     script.filename = filename;
     script.filepath = fullpath;
     script.modulepath = fullpath.substr(0, fullpath.length() - filename.length() - ext.length());
+    script.modified = GetFileModTime(fullpath);
     if (extension)
         lua_extensions.push_back(script);
     else
@@ -391,129 +662,214 @@ void Eluna::AddScriptPath(std::string filename, const std::string& fullpath)
     ELUNA_LOG_DEBUG("[Eluna]: AddScriptPath add path `{}`", fullpath);
 }
 
-std::time_t Eluna::GetFileModTime(const std::string& filepath)
+uint64 Eluna::GetFileModTime(const std::string& filepath)
 {
     struct stat fileInfo;
-    if (stat(filepath.c_str(), &fileInfo) == 0)
-        return fileInfo.st_mtime;
-    return 0;
+    if (stat(filepath.c_str(), &fileInfo) != 0)
+        return 0;
+
+    // Whole seconds would miss a second save, or a checkout, within the same second as the last scan
+#if defined ELUNA_WINDOWS
+    return uint64(fileInfo.st_mtime) * 1000000000;
+#elif defined __APPLE__
+    return uint64(fileInfo.st_mtimespec.tv_sec) * 1000000000 + fileInfo.st_mtimespec.tv_nsec;
+#else
+    return uint64(fileInfo.st_mtim.tv_sec) * 1000000000 + fileInfo.st_mtim.tv_nsec;
+#endif
 }
 
-std::time_t Eluna::GetFileModTimeWithCache(const std::string& filepath)
+uint64 Eluna::GetFileModTimeWithCache(const std::string& filepath)
 {
     auto it = timestampCache.find(filepath);
     if (it != timestampCache.end())
         return it->second;
     
-    std::time_t modTime = GetFileModTime(filepath);
+    uint64 modTime = GetFileModTime(filepath);
     timestampCache[filepath] = modTime;
     return modTime;
 }
 
-bool Eluna::CompileScriptToGlobalCache(const std::string& filepath)
+// Reads the script source so it can be looked up in the disk cache
+static bool ReadScriptSource(const std::string& filepath, std::string& source)
 {
-    std::lock_guard<std::mutex> lock(globalCacheMutex);
-    
-    lua_State* tempL = luaL_newstate();
-    if (!tempL)
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open())
         return false;
 
-    int result = luaL_loadfile(tempL, filepath.c_str());
-    if (result != LUA_OK)
+    source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+// Looks the source up in the disk cache, `hash` and `sourceSize` are set so a miss can be stored afterwards
+static std::shared_ptr<ElunaBytecodeBlob> LoadFromDiskCache(const std::string& filepath, ElunaBytecodeCache::SourceType type, uint64& hash, size_t& sourceSize)
+{
+    if (!ElunaBytecodeCache::IsEnabled())
+        return NULL;
+
+    std::string source;
+    if (!ReadScriptSource(filepath, source))
+        return NULL;
+
+    hash = ElunaBytecodeCache::HashSource(filepath, source, type);
+    sourceSize = source.size();
+    return ElunaBytecodeCache::Load(filepath, hash, sourceSize);
+}
+
+static void StoreToDiskCache(const GlobalCacheEntry& cacheEntry, uint64 hash, size_t sourceSize)
+{
+    if (ElunaBytecodeCache::IsEnabled() && sourceSize)
+        ElunaBytecodeCache::Store(cacheEntry.filepath, hash, sourceSize, cacheEntry.bytecode.data(), cacheEntry.bytecode.size());
+}
+
+static int BytecodeWriter(lua_State* /*L*/, const void* p, size_t sz, void* ud)
+{
+    BytecodeBuffer* buffer = static_cast<BytecodeBuffer*>(ud);
+    const uint8* bytes = static_cast<const uint8*>(p);
+    buffer->insert(buffer->end(), bytes, bytes + sz);
+    return 0;
+}
+
+// Compiles the script into `cacheEntry` using `compiler`, which is left as it was found
+static bool CompileScript(lua_State* compiler, const std::string& filepath, bool isMoonScript, GlobalCacheEntry& cacheEntry)
+{
+    int top = lua_gettop(compiler);
+    int result;
+    if (isMoonScript)
     {
-        lua_close(tempL);
-        return false;
+        // The moonscript module stays loaded in the compiler between scripts
+        std::string moonscriptLoader = "return require('moonscript').loadfile([[" + filepath + "]])";
+        result = luaL_loadstring(compiler, moonscriptLoader.c_str());
+        if (result == LUA_OK)
+            result = lua_pcall(compiler, 0, 1, 0);
+        if (result == LUA_OK && !lua_isfunction(compiler, -1))
+            result = LUA_ERRSYNTAX;
     }
+    else
+        result = luaL_loadfile(compiler, filepath.c_str());
 
-    std::time_t modTime = GetFileModTime(filepath);
-    
-    auto& cacheEntry = globalBytecodeCache[filepath];
-    cacheEntry.last_modified = modTime;
+    if (result == LUA_OK)
+    {
+        cacheEntry.bytecode.reserve(isMoonScript ? 2048 : 1024);
+        result = lua_dump(compiler, BytecodeWriter, &cacheEntry.bytecode);
+    }
+
+    lua_settop(compiler, top);
+    return result == LUA_OK && !cacheEntry.bytecode.empty();
+}
+
+bool Eluna::CompileToGlobalCache(lua_State*& compiler, const std::string& filepath, bool isMoonScript)
+{
+    {
+        // Only one thread compiles a script at a time, others wait for its result
+        std::unique_lock<std::mutex> lock(globalCacheMutex);
+        compileFinished.wait(lock, [&filepath]() { return compilingScripts.find(filepath) == compilingScripts.end(); });
+
+        auto it = globalBytecodeCache.find(filepath);
+        if (it != globalBytecodeCache.end() && it->second.GetSize() && it->second.last_modified == GetFileModTime(filepath))
+            return true;
+
+        compilingScripts.insert(filepath);
+    }
+
+    GlobalCacheEntry cacheEntry;
     cacheEntry.filepath = filepath;
-    cacheEntry.bytecode.clear();
-    cacheEntry.bytecode.reserve(1024);
-
-    struct BytecodeWriter {
-        BytecodeBuffer* buffer;
-        static int writer(lua_State*, const void* p, size_t sz, void* ud) {
-            BytecodeWriter* w = static_cast<BytecodeWriter*>(ud);
-            const uint8* bytes = static_cast<const uint8*>(p);
-            w->buffer->insert(w->buffer->end(), bytes, bytes + sz);
-            return 0;
+    cacheEntry.last_modified = GetFileModTime(filepath);
+
+    uint64 sourceHash = 0;
+    size_t sourceSize = 0;
+    ElunaBytecodeCache::SourceType type = isMoonScript ? ElunaBytecodeCache::SOURCE_MOONSCRIPT : ElunaBytecodeCache::SOURCE_LUA;
+    cacheEntry.blob = LoadFromDiskCache(filepath, type, sourceHash, sourceSize);
+
+    bool success = cacheEntry.blob != NULL;
+    if (!success)
+    {
+        if (!compiler)
+        {
+            compiler = luaL_newstate();
+            if (compiler)
+                luaL_openlibs(compiler);
         }
-    };
 
-    BytecodeWriter writer;
-    writer.buffer = &cacheEntry.bytecode;
+        success = compiler && CompileScript(compiler, filepath, isMoonScript, cacheEntry);
+        if (success)
+            StoreToDiskCache(cacheEntry, sourceHash, sourceSize);
+    }
 
-    int dumpResult = lua_dump(tempL, BytecodeWriter::writer, &writer);
-    if (dumpResult != LUA_OK || cacheEntry.bytecode.empty())
     {
-        globalBytecodeCache.erase(filepath);
-        lua_close(tempL);
-        return false;
+        std::lock_guard<std::mutex> lock(globalCacheMutex);
+        if (success)
+            globalBytecodeCache[filepath] = std::move(cacheEntry);
+        else
+            globalBytecodeCache.erase(filepath);
+        compilingScripts.erase(filepath);
     }
+    compileFinished.notify_all();
+    return success;
+}
 
-    lua_close(tempL);
-    return true;
+bool Eluna::CompileScriptToGlobalCache(const std::string& filepath)
+{
+    lua_State* compiler = NULL;
+    bool success = CompileToGlobalCache(compiler, filepath, false);
+    if (compiler)
+        lua_close(compiler);
+    return success;
 }
 
 bool Eluna::CompileMoonScriptToGlobalCache(const std::string& filepath)
 {
-    std::lock_guard<std::mutex> lock(globalCacheMutex);
-    
-    lua_State* tempL = luaL_newstate();
-    if (!tempL)
-        return false;
-
-    luaL_openlibs(tempL);
+    lua_State* compiler = NULL;
+    bool success = CompileToGlobalCache(compiler, filepath, true);
+    if (compiler)
+        lua_close(compiler);
+    return success;
+}
 
-    std::string moonscriptLoader = "return require('moonscript').loadfile([[" + filepath + "]])";
-    int result = luaL_loadstring(tempL, moonscriptLoader.c_str());
-    if (result != LUA_OK)
+uint32 Eluna::CompileScripts(const ScriptList& scripts)
+{
+    std::vector<const LuaScript*> pending;
     {
-        lua_close(tempL);
-        return false;
-    }
+        std::lock_guard<std::mutex> lock(globalCacheMutex);
+        for (ScriptList::const_iterator it = scripts.begin(); it != scripts.end(); ++it)
+        {
+            if (it->fileext != ".lua" && it->fileext != ".ext" && it->fileext != ".moon")
+                continue;
 
-    result = lua_pcall(tempL, 0, 1, 0);
-    if (result != LUA_OK)
-    {
-        lua_close(tempL);
-        return false;
+            auto cached = globalBytecodeCache.find(it->filepath);
+            if (cached == globalBytecodeCache.end() || !cached->second.GetSize() || cached->second.last_modified != GetFileModTimeWithCache(it->filepath))
+                pending.push_back(&*it);
+        }
     }
 
-    std::time_t modTime = GetFileModTime(filepath);
-    
-    auto& cacheEntry = globalBytecodeCache[filepath];
-    cacheEntry.last_modified = modTime;
-    cacheEntry.filepath = filepath;
-    cacheEntry.bytecode.clear();
-    cacheEntry.bytecode.reserve(2048);
-
-    struct BytecodeWriter {
-        BytecodeBuffer* buffer;
-        static int writer(lua_State*, const void* p, size_t sz, void* ud) {
-            BytecodeWriter* w = static_cast<BytecodeWriter*>(ud);
-            const uint8* bytes = static_cast<const uint8*>(p);
-            w->buffer->insert(w->buffer->end(), bytes, bytes + sz);
-            return 0;
-        }
+    if (pending.empty())
+        return 0;
+
+    std::atomic<size_t> next(0);
+    std::atomic<uint32> compiled(0);
+    auto compile = [&pending, &next, &compiled]()
+    {
+        // Each worker keeps its compiler state for all the scripts it takes
+        lua_State* compiler = NULL;
+        for (size_t i = next++; i < pending.size(); i = next++)
+            if (CompileToGlobalCache(compiler, pending[i]->filepath, pending[i]->fileext == ".moon"))
+                ++compiled;
+        if (compiler)
+            lua_close(compiler);
     };
 
-    BytecodeWriter writer;
-    writer.buffer = &cacheEntry.bytecode;
+    size_t workerCount = std::min<size_t>(pending.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount - 1);
+    for (size_t i = 1; i < workerCount; ++i)
+        workers.emplace_back(compile);
 
-    int dumpResult = lua_dump(tempL, BytecodeWriter::writer, &writer);
-    if (dumpResult != LUA_OK || cacheEntry.bytecode.empty())
-    {
-        globalBytecodeCache.erase(filepath);
-        lua_close(tempL);
-        return false;
-    }
+    // The calling thread compiles too instead of only waiting
+    compile();
+    for (std::thread& worker : workers)
+        worker.join();
 
-    lua_close(tempL);
-    return true;
+    ELUNA_LOG_DEBUG("[Eluna]: Compiled {} of {} changed scripts on {} threads", compiled.load(), pending.size(), workerCount);
+    return compiled;
 }
 
 int Eluna::TryLoadFromGlobalCache(lua_State* L, const std::string& filepath)
@@ -521,14 +877,14 @@ int Eluna::TryLoadFromGlobalCache(lua_State* L, const std::string& filepath)
     std::lock_guard<std::mutex> lock(globalCacheMutex);
     
     auto it = globalBytecodeCache.find(filepath);
-    if (it == globalBytecodeCache.end() || it->second.bytecode.empty())
+    if (it == globalBytecodeCache.end() || !it->second.GetSize())
         return LUA_ERRFILE;
     
-    std::time_t currentModTime = GetFileModTimeWithCache(filepath);
+    uint64 currentModTime = GetFileModTimeWithCache(filepath);
     if (it->second.last_modified != currentModTime || currentModTime == 0)
         return LUA_ERRFILE;
     
-    return luaL_loadbuffer(L, reinterpret_cast<const char*>(it->second.bytecode.data()), it->second.bytecode.size(), filepath.c_str());
+    return luaL_loadbuffer(L, it->second.GetData(), it->second.GetSize(), filepath.c_str());
 }
 
 int Eluna::LoadScriptWithCache(lua_State* L, const std::string& filepath, bool isMoonScript, uint32* compiledCount, uint32* cachedCount)
@@ -553,9 +909,9 @@ int Eluna::LoadScriptWithCache(lua_State* L, const std::string& filepath, bool i
             if (compiledCount) (*compiledCount)++;
             std::lock_guard<std::mutex> lock(globalCacheMutex);
             auto it = globalBytecodeCache.find(filepath);
-            if (it != globalBytecodeCache.end() && !it->second.bytecode.empty())
+            if (it != globalBytecodeCache.end() && it->second.GetSize())
             {
-                result = luaL_loadbuffer(L, reinterpret_cast<const char*>(it->second.bytecode.data()), it->second.bytecode.size(), filepath.c_str());
+                result = luaL_loadbuffer(L, it->second.GetData(), it->second.GetSize(), filepath.c_str());
                 if (result == LUA_OK)
                     return LUA_OK;
             }
@@ -623,11 +979,12 @@ void Eluna::GetScripts(std::string path)
 
     if (boost::filesystem::exists(someDir) && boost::filesystem::is_directory(someDir))
     {
-        lua_requirepath +=
-            path + "/?.lua;" +
-            path + "/?.moon" +
-            path + "/?.ext;";
-        
+        // Lua modules are found through the module index, C modules through package.cpath
+        std::string folder = someDir.generic_string();
+        while (folder.length() > 1 && folder[folder.length() - 1] == '/')
+            folder.erase(folder.length() - 1);
+        lua_scriptfolders.push_back(folder);
+
         lua_requirecpath +=
             path + "/?.dll;" +
             path + "/?.so;";
@@ -664,32 +1021,196 @@ void Eluna::GetScripts(std::string path)
     }
 }
 
+void Eluna::BuildModuleIndex()
+{
+    std::unordered_map<std::string, uint32> folderOrder;
+    for (uint32 i = 0; i < lua_scriptfolders.size(); ++i)
+        folderOrder.emplace(lua_scriptfolders[i], i);
+
+    // Same precedence the package.path patterns had: folder first, then .lua, .moon, .ext
+    std::shared_ptr<ModuleIndex> index = std::make_shared<ModuleIndex>();
+    std::unordered_map<std::string, std::pair<uint32, uint32>> ranks;
+    for (const ScriptList* scripts : { &lua_scripts, &lua_extensions })
+    {
+        for (ScriptList::const_iterator it = scripts->begin(); it != scripts->end(); ++it)
+        {
+            uint32 extOrder;
+            if (it->fileext == ".lua")
+                extOrder = 0;
+            else if (it->fileext == ".moon")
+                extOrder = 1;
+            else if (it->fileext == ".ext")
+                extOrder = 2;
+            else
+                continue;
+
+            // Every folder above the script finds it, by its path relative to that folder
+            std::string folder = it->modulepath.substr(0, it->modulepath.length() - 1);
+            std::string name = it->filename;
+            for (auto order = folderOrder.find(folder); order != folderOrder.end(); order = folderOrder.find(folder))
+            {
+                std::pair<uint32, uint32> rank(order->second, extOrder);
+                auto ranked = ranks.find(name);
+                if (ranked == ranks.end() || rank < ranked->second)
+                {
+                    ranks[name] = rank;
+                    (*index)[name] = *it;
+                }
+
+                std::size_t slash = folder.find_last_of('/');
+                if (slash == std::string::npos)
+                    break;
+                name = folder.substr(slash + 1) + "/" + name;
+                folder.erase(slash);
+            }
+        }
+    }
+
+    lua_modules = index;
+    ELUNA_LOG_DEBUG("[Eluna]: Indexed {} module names", index->size());
+}
+
+int Eluna::SearchModule(lua_State* L)
+{
+    const char* module = luaL_checkstring(L, 1);
+    std::string name = module;
+    std::replace(name.begin(), name.end(), '.', '/');
+
+    Eluna* E = GetEluna(L);
+    ModuleIndex::const_iterator it;
+    if (!E || !E->moduleIndex || (it = E->moduleIndex->find(name)) == E->moduleIndex->end())
+    {
+#if LUA_VERSION_NUM > 503
+        lua_pushfstring(L, "no script '%s' in the script folder", name.c_str());
+#else
+        lua_pushfstring(L, "\n\tno script '%s' in the script folder", name.c_str());
+#endif
+        return 1;
+    }
+
+    // Copied, the index can be replaced by a reload while the module runs
+    LuaScript script = it->second;
+    if (LoadScriptWithCache(L, script.filepath, script.fileext == ".moon"))
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", module, script.filepath.c_str(), lua_tostring(L, -1));
+
+    // Passed to the loader as the second argument, like the stock searchers do
+    lua_pushstring(L, script.filepath.c_str());
+    return 2;
+}
+
 static bool ScriptPathComparator(const LuaScript& first, const LuaScript& second)
 {
     return first.filepath < second.filepath;
 }
 
-void Eluna::RunScripts()
+void Eluna::GetScriptList(ScriptList& scripts)
 {
-    LOCK_ELUNA;
+    lua_extensions.sort(ScriptPathComparator);
+    lua_scripts.sort(ScriptPathComparator);
+    scripts.insert(scripts.end(), lua_extensions.begin(), lua_extensions.end());
+    scripts.insert(scripts.end(), lua_scripts.begin(), lua_scripts.end());
+}
+
+bool Eluna::RunScript(const LuaScript& script, int modules, uint32* compiledCount, uint32* cachedCount, uint32* precompiledCount)
+{
+    // Stack: package, modules
+    if (script.fileext == ".moon")
+    {
+        if (LoadScriptWithCache(L, script.filepath, true, compiledCount, cachedCount))
+        {
+            // Stack: package, modules, errmsg
+            ELUNA_LOG_ERROR("[Eluna]: Error loading MoonScript `{}`", script.filepath);
+            Report(L);
+            // Stack: package, modules
+            return false;
+        }
+    }
+    else if (script.fileext == ".out")
+    {
+        if (LoadCompiledScript(L, script.filepath))
+        {
+            // Stack: package, modules, errmsg
+            ELUNA_LOG_ERROR("[Eluna]: Error loading compiled script `{}`", script.filepath);
+            Report(L);
+            // Stack: package, modules
+            return false;
+        }
+        if (precompiledCount)
+            (*precompiledCount)++;
+    }
+    else if (script.fileext == ".lua" || script.fileext == ".ext")
+    {
+        if (LoadScriptWithCache(L, script.filepath, false, compiledCount, cachedCount))
+        {
+            // Stack: package, modules, errmsg
+            ELUNA_LOG_ERROR("[Eluna]: Error loading `{}`", script.filepath);
+            Report(L);
+            // Stack: package, modules
+            return false;
+        }
+    }
+    else
+    {
+       if (luaL_loadfile(L, script.filepath.c_str()))
+       {
+           // Stack: package, modules, errmsg
+           ELUNA_LOG_ERROR("[Eluna]: Error loading `{}`", script.filepath);
+           Report(L);
+           // Stack: package, modules
+           return false;
+       }
+    }
+
+    // Stack: package, modules, filefunc
+    if (!ExecuteCall(0, 1))
+        return false;
+
+    // Stack: package, modules, result
+    if (lua_isnoneornil(L, -1) || (lua_isboolean(L, -1) && !lua_toboolean(L, -1)))
+    {
+        // if result evaluates to false, change it to true
+        lua_pop(L, 1);
+        Push(L, true);
+    }
+    lua_setfield(L, modules, script.filename.c_str());
+    // Stack: package, modules
+
+    // successfully loaded and ran file
+    ELUNA_LOG_DEBUG("[Eluna]: Successfully loaded `{}`", script.filepath);
+    return true;
+}
+
+bool Eluna::RunScripts()
+{
+    // State lock first, the script lists are shared by all states and guarded by the world lock
+    Guard stateGuard(GetStateLock());
+    std::unique_lock<LockType> worldGuard(GetLock());
     if (!ElunaConfig::GetInstance().IsElunaEnabled())
-        return;
+        return true;
 
     uint32 oldMSTime = ElunaUtil::GetCurrTime();
     uint32 count = 0;
     uint32 compiledCount = 0;
     uint32 cachedCount = 0;
     uint32 precompiledCount = 0;
+    uint32 parallelCount = 0;
+    uint32 errors = 0;
     bool cacheEnabled = eConfigMgr->GetOption<bool>("Eluna.BytecodeCache", true);
     
     if (cacheEnabled)
         ClearTimestampCache();
 
     ScriptList scripts;
-    lua_extensions.sort(ScriptPathComparator);
-    lua_scripts.sort(ScriptPathComparator);
-    scripts.insert(scripts.end(), lua_extensions.begin(), lua_extensions.end());
-    scripts.insert(scripts.end(), lua_scripts.begin(), lua_scripts.end());
+    GetScriptList(scripts);
+
+    // Only the world state shares its hooks with the world lock. Map and staged states run their
+    // scripts under their own lock, so the world and other maps can keep running meanwhile
+    if (staged || IsMapState())
+        worldGuard.unlock();
+
+    // Changed scripts are compiled in parallel up front, the loop below then only loads bytecode in order
+    if (cacheEnabled)
+        parallelCount = CompileScripts(scripts);
 
     std::unordered_map<std::string, std::string> loaded; // filename, path
 
@@ -719,88 +1240,195 @@ void Eluna::RunScripts()
         lua_pop(L, 1);
         // Stack: package, modules
 
-        if (it->fileext == ".moon")
-        {
-            if (LoadScriptWithCache(L, it->filepath, true, &compiledCount, &cachedCount))
-            {
-                // Stack: package, modules, errmsg
-                ELUNA_LOG_ERROR("[Eluna]: Error loading MoonScript `{}`", it->filepath);
-                Report(L);
-                // Stack: package, modules
-                continue;
-            }
-        }
-        else if (it->fileext == ".out")
-        {
-            if (LoadCompiledScript(L, it->filepath))
-            {
-                // Stack: package, modules, errmsg
-                ELUNA_LOG_ERROR("[Eluna]: Error loading compiled script `{}`", it->filepath);
-                Report(L);
-                // Stack: package, modules
-                continue;
-            }
-            precompiledCount++;
-        }
-        else if (it->fileext == ".lua" || it->fileext == ".ext")
-        {
-            if (LoadScriptWithCache(L, it->filepath, false, &compiledCount, &cachedCount))
-            {
-                // Stack: package, modules, errmsg
-                ELUNA_LOG_ERROR("[Eluna]: Error loading `{}`", it->filepath);
-                Report(L);
-                // Stack: package, modules
-                continue;
-            }
-        }
-        else
-        {
-           if (luaL_loadfile(L, it->filepath.c_str()))
-           {
-               // Stack: package, modules, errmsg
-               ELUNA_LOG_ERROR("[Eluna]: Error loading `{}`", it->filepath);
-               Report(L);
-               // Stack: package, modules
-               continue;
-           }
-        }
-
-        // Stack: package, modules, filefunc
-        if (ExecuteCall(0, 1))
-        {
-            // Stack: package, modules, result
-            if (lua_isnoneornil(L, -1) || (lua_isboolean(L, -1) && !lua_toboolean(L, -1)))
-            {
-                // if result evaluates to false, change it to true
-                lua_pop(L, 1);
-                Push(L, true);
-            }
-            lua_setfield(L, modules, it->filename.c_str());
-            // Stack: package, modules
-
-            // successfully loaded and ran file
-            ELUNA_LOG_DEBUG("[Eluna]: Successfully loaded `{}`", it->filepath);
+        if (RunScript(*it, modules, &compiledCount, &cachedCount, &precompiledCount))
             ++count;
-            continue;
-        }
+        else
+            ++errors;
     }
     // Stack: package, modules
     lua_pop(L, 2);
     
+    // Scripts compiled up front were counted as cached when loaded
+    cachedCount -= std::min(cachedCount, parallelCount);
+    compiledCount += parallelCount;
+
     std::string details = "";
     if (cacheEnabled && (compiledCount > 0 || cachedCount > 0 || precompiledCount > 0))
     {
         details = fmt::format("({} compiled, {} cached, {} pre-compiled)", compiledCount, cachedCount, precompiledCount);
     }
-    ELUNA_LOG_INFO("[Eluna]: Executed {} Lua scripts in {} ms {}", count, ElunaUtil::GetTimeDiff(oldMSTime), details);
+    if (IsMapState())
+        ELUNA_LOG_DEBUG("[Eluna]: Executed {} Lua scripts for map {} instance {} in {} ms {}", count, GetBoundMapId(), GetBoundInstanceId(), ElunaUtil::GetTimeDiff(oldMSTime), details);
+    else
+        ELUNA_LOG_INFO("[Eluna]: Executed {} Lua scripts in {} ms {}", count, ElunaUtil::GetTimeDiff(oldMSTime), details);
 
-    OnLuaStateOpen();
+    // A staged state runs its open hooks once it has been swapped in
+    if (!staged)
+        OnLuaStateOpen();
+    return !errors;
+}
+
+void Eluna::ReloadChangedScripts()
+{
+    // Modification times of the scripts the states were loaded with
+    std::unordered_map<std::string, uint64> previous;
+    for (ScriptList::const_iterator it = lua_extensions.begin(); it != lua_extensions.end(); ++it)
+        previous[it->filepath] = it->modified;
+    for (ScriptList::const_iterator it = lua_scripts.begin(); it != lua_scripts.end(); ++it)
+        previous[it->filepath] = it->modified;
+
+    LoadScriptPaths();
+
+    ScriptList scripts;
+    GetScriptList(scripts);
+
+    std::unordered_set<std::string> changed;
+    for (ScriptList::const_iterator it = scripts.begin(); it != scripts.end(); ++it)
+    {
+        auto old = previous.find(it->filepath);
+        if (old == previous.end() || old->second != it->modified)
+            changed.insert(it->filepath);
+        if (old != previous.end())
+            previous.erase(old);
+    }
+
+    // Whatever is left was deleted
+    for (auto it = previous.begin(); it != previous.end(); ++it)
+        changed.insert(it->first);
+
+    if (changed.empty())
+    {
+        ELUNA_LOG_INFO("[Eluna]: No changed scripts to reload");
+        return;
+    }
+
+    // Reload runs on the world update, map states are not in use at this point.
+    // _ReloadEluna has locked them before the world lock already.
+    std::vector<Eluna*> states;
+    states.push_back(sEluna);
+    {
+        std::shared_lock<std::shared_mutex> guard(mapStatesLock);
+        for (MapStateList::const_iterator it = mapStates.begin(); it != mapStates.end(); ++it)
+            states.push_back(it->second);
+    }
+
+    for (Eluna* E : states)
+    {
+        Guard guard(E->GetStateLock());
+        E->ReloadModules(scripts, changed);
+    }
+}
+
+bool Eluna::ReloadModules(const ScriptList& scripts, std::unordered_set<std::string> reloaded)
+{
+    if (!L)
+        return true;
+
+    // require() finds scripts added since the last scan
+    moduleIndex = lua_modules;
+
+    uint32 oldMSTime = ElunaUtil::GetCurrTime();
+    size_t changedCount = reloaded.size();
+    scriptModules.AddDependents(reloaded);
+
+    lua_getglobal(L, "package");
+    // Stack: package
+    luaL_getsubtable(L, -1, "loaded");
+    // Stack: package, modules
+    int modules = lua_gettop(L);
+
+    // Everything is unloaded first, so no script gets the old version of another through require.
+    // The names are collected before that, unloading a script forgets what it required
+    std::unordered_set<std::string> names;
+    for (const std::string& path : reloaded)
+        scriptModules.GetRequireNames(path, names);
+    for (const std::string& path : reloaded)
+        scriptModules.Unload(path, eventMgr);
+    for (const std::string& name : names)
+    {
+        lua_pushnil(L);
+        lua_setfield(L, modules, name.c_str());
+    }
+
+    ScriptList pending;
+    for (ScriptList::const_iterator it = scripts.begin(); it != scripts.end(); ++it)
+        if (reloaded.find(it->filepath) != reloaded.end())
+            pending.push_back(*it);
+
+    if (ElunaConfig::GetInstance().IsByteCodeCacheEnabled())
+    {
+        ClearTimestampCache();
+        CompileScripts(pending);
+    }
+
+    uint32 count = 0;
+    uint32 errors = 0;
+    for (ScriptList::const_iterator it = pending.begin(); it != pending.end(); ++it)
+    {
+        // A script run before may have required it already
+        lua_getfield(L, modules, it->filename.c_str());
+        bool loaded = !lua_isnoneornil(L, -1);
+        lua_pop(L, 1);
+        if (loaded)
+            continue;
+
+        if (RunScript(*it, modules, NULL, NULL, NULL))
+            ++count;
+        else
+            ++errors;
+    }
+    // Stack: package, modules
+    lua_pop(L, 2);
+
+    if (IsMapState())
+        ELUNA_LOG_DEBUG("[Eluna]: Reloaded {} Lua scripts for map {} instance {} in {} ms ({} changed)", count, GetBoundMapId(), GetBoundInstanceId(), ElunaUtil::GetTimeDiff(oldMSTime), changedCount);
+    else
+        ELUNA_LOG_INFO("[Eluna]: Reloaded {} Lua scripts in {} ms ({} changed)", count, ElunaUtil::GetTimeDiff(oldMSTime), changedCount);
+    return !errors;
 }
 
 void Eluna::InvalidateObjects()
 {
-    ++callstackid;
-    ASSERT(callstackid && "Callstackid overflow");
+    ++*callstackid;
+    ASSERT(*callstackid && "Callstackid overflow");
+}
+
+void Eluna::UpdateCallbacks(uint32 diff)
+{
+    // Callbacks find their state through the Lua state, which must be locked for that
+    LOCK_ELUNA_STATE;
+
+    uint32 budget = ElunaConfig::GetInstance().GetUpdateBudget();
+    if (!budget)
+    {
+        eventMgr->globalProcessor->Update(diff);
+        httpManager.HandleHttpResponses();
+        queryProcessor.ProcessReadyCallbacks();
+        return;
+    }
+
+    // Every source gets an equal share of the time left and at least one callback. The first
+    // one changes every update, so a burst from one source can't keep the others waiting.
+    const uint32 sources = 3;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(budget);
+    uint32 first = callbackRound++;
+    for (uint32 i = 0; i < sources; ++i)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        ElunaUtil::Deadline deadline = now < end ? now + (end - now) / (sources - i) : now;
+        switch ((first + i) % sources)
+        {
+            case 0:
+                eventMgr->globalProcessor->Update(diff, deadline);
+                break;
+            case 1:
+                httpManager.HandleHttpResponses(deadline);
+                break;
+            default:
+                queryProcessor.ProcessReadyCallbacks(deadline);
+                break;
+        }
+    }
 }
 
 void Eluna::Report(lua_State* _L)
@@ -837,7 +1465,7 @@ int Eluna::StackTrace(lua_State *_L)
 
     // dirty stack?
     // Stack: errmsg, debug, tracemsg
-    sEluna->OnError(std::string(lua_tostring(_L, -1)));
+    GetEluna(_L)->OnError(std::string(lua_tostring(_L, -1)));
     return 1;
 }
 
@@ -1043,28 +1671,25 @@ void Eluna::Push(lua_State* luastate, CreatureTemplate const* creatureTemplate)
     Push<CreatureTemplate>(luastate, creatureTemplate);
 }
 
-std::string Eluna::FormatQuery(lua_State* L, const char* query)
+std::string Eluna::FormatQuery(lua_State* L, const char* query, int firstArg)
 {
     int numArgs = lua_gettop(L);
     std::string formattedQuery = query;
 
     size_t position = 0;
-    for (int i = 2; i <= numArgs; ++i) 
+    for (int i = firstArg; i <= numArgs; ++i) 
     {
         std::string arg;
 
         if (lua_isnumber(L, i)) 
         {
-            arg = std::to_string(lua_tonumber(L, i));
+            arg = ElunaStatement::FormatNumber(lua_tonumber(L, i));
         } 
         else if (lua_isstring(L, i)) 
         {
-            std::string value = lua_tostring(L, i);
-            for (size_t pos = 0; (pos = value.find('\'', pos)) != std::string::npos; pos += 2)
-            {
-                value.insert(pos, "'");
-            }
-            arg = "'" + value + "'";
+            size_t length;
+            const char* value = lua_tolstring(L, i, &length);
+            arg = ElunaStatement::FormatString(value, length);
         } 
         else 
         {
@@ -1263,9 +1888,24 @@ static int cancelBinding(lua_State *L)
     return 0;
 }
 
+template<typename K>
+static void removeModuleBinding(void* bindings, uint64 bindingID)
+{
+    static_cast<BindingMap<K>*>(bindings)->Remove(bindingID);
+}
+
+template<typename K>
+static bool hasModuleBinding(void* bindings, uint64 bindingID)
+{
+    return static_cast<BindingMap<K>*>(bindings)->Contains(bindingID);
+}
+
 template<typename K>
 static void createCancelCallback(lua_State* L, uint64 bindingID, BindingMap<K>* bindings)
 {
+    // Lets a reload of the calling script remove the binding
+    Eluna::GetEluna(L)->scriptModules.AddBinding(L, bindings, &removeModuleBinding<K>, &hasModuleBinding<K>, bindingID);
+
     Eluna::Push(L, bindingID);
     lua_pushlightuserdata(L, bindings);
     // Stack: bindingID, bindings
@@ -1599,6 +2239,21 @@ CreatureAI* Eluna::GetAI(Creature* creature)
     if (!ElunaConfig::GetInstance().IsElunaEnabled())
         return NULL;
 
+    if (GetCreatureBindingMask(creature))
+        return new ElunaCreatureAI(this, creature);
+
+    return NULL;
+}
+
+/*
+ * Returns a bitmask of the CreatureEvents bound to the creature's entry or GUID,
+ *   bit N set meaning event N has at least one binding.
+ */
+uint64 Eluna::GetCreatureBindingMask(Creature const* creature)
+{
+    static_assert(Hooks::CREATURE_EVENT_COUNT <= 64, "CreatureEvents do not fit the binding mask");
+
+    uint64 mask = 0;
     for (int i = 1; i < Hooks::CREATURE_EVENT_COUNT; ++i)
     {
         Hooks::CreatureEvents event_id = (Hooks::CreatureEvents)i;
@@ -1608,10 +2263,19 @@ CreatureAI* Eluna::GetAI(Creature* creature)
 
         if (CreatureEventBindings->HasBindingsFor(entryKey) ||
             CreatureUniqueBindings->HasBindingsFor(uniqueKey))
-            return new ElunaCreatureAI(creature);
+            mask |= uint64(1) << i;
     }
 
-    return NULL;
+    return mask;
+}
+
+/*
+ * Changes whenever a creature binding is added or removed, so the result
+ *   of GetCreatureBindingMask can be cached until then.
+ */
+uint32 Eluna::GetCreatureBindingGeneration() const
+{
+    return CreatureEventBindings->GetGeneration() + CreatureUniqueBindings->GetGeneration();
 }
 
 InstanceData* Eluna::GetInstanceData(Map* map)
@@ -1627,7 +2291,7 @@ InstanceData* Eluna::GetInstanceData(Map* map)
 
         if (MapEventBindings->HasBindingsFor(key) ||
             InstanceEventBindings->HasBindingsFor(key))
-            return new ElunaInstanceAI(map);
+            return new ElunaInstanceAI(this, map);
     }
 
     return NULL;
@@ -1680,7 +2344,7 @@ void Eluna::CreateInstanceData(Map const* map)
  */
 void Eluna::FreeInstanceId(uint32 instanceId)
 {
-    LOCK_ELUNA;
+    LOCK_ELUNA_STATE;
 
     if (!ElunaConfig::GetInstance().IsElunaEnabled())
         return;
@@ -25,12 +25,18 @@
 #include "TicketMgr.h"
 #include "LootMgr.h"
 #include "ElunaFileWatcher.h"
+#include "ElunaBytecodeCache.h"
+#include "ElunaScriptModules.h"
+#include "ElunaQueryProcessor.h"
 #include "ElunaConfig.h"
+#include <future>
 #include <mutex>
+#include <shared_mutex>
 #include <memory>
 #include <vector>
 #include <ctime>
 #include <unordered_map>
+#include <unordered_set>
 
 extern "C"
 {
@@ -85,12 +91,17 @@ typedef std::vector<uint8> BytecodeBuffer;
 struct GlobalCacheEntry
 {
     BytecodeBuffer bytecode;
-    std::time_t last_modified;
+    // Set instead of `bytecode` when the script was found in the disk cache
+    std::shared_ptr<ElunaBytecodeBlob> blob;
+    uint64 last_modified;
     std::string filepath;
     
     GlobalCacheEntry() : last_modified(0) {}
-    GlobalCacheEntry(const BytecodeBuffer& code, std::time_t modTime, const std::string& path)
+    GlobalCacheEntry(const BytecodeBuffer& code, uint64 modTime, const std::string& path)
         : bytecode(code), last_modified(modTime), filepath(path) {}
+
+    const char* GetData() const { return blob ? blob->GetData() : reinterpret_cast<const char*>(bytecode.data()); }
+    size_t GetSize() const { return blob ? blob->GetSize() : bytecode.size(); }
 };
 
 struct LuaScript
@@ -99,11 +110,15 @@ struct LuaScript
     std::string filename;
     std::string filepath;
     std::string modulepath;
-    LuaScript() {}
+    // In nanoseconds, see Eluna::GetFileModTime
+    uint64 modified;
+    LuaScript() : modified(0) {}
 };
 
 #define ELUNA_STATE_PTR "Eluna State Ptr"
 #define LOCK_ELUNA Eluna::Guard __guard(Eluna::GetLock())
+// Locks the state the current Eluna instance belongs to, use inside Eluna members
+#define LOCK_ELUNA_STATE Eluna::Guard __guard(GetStateLock())
 
 #define ELUNA_GAME_API AC_GAME_API
 
@@ -111,6 +126,9 @@ class ELUNA_GAME_API Eluna
 {
 public:
     typedef std::list<LuaScript> ScriptList;
+    typedef std::unordered_map<Map const*, Eluna*> MapStateList;
+    // Module name as passed to require(), with dots as slashes -> script
+    typedef std::unordered_map<std::string, LuaScript> ModuleIndex;
 
     typedef std::recursive_mutex LockType;
     typedef std::lock_guard<LockType> Guard;
@@ -121,8 +139,11 @@ public:
 private:
     static bool reload;
     static bool initialized;
+    static bool multistate;
     static LockType lock;
     static std::unique_ptr<ElunaFileWatcher> fileWatcher;
+    // World state being built on a background thread by an async reload
+    static std::future<Eluna*> stagedReload;
 
     // Lua script locations
     static ScriptList lua_scripts;
@@ -133,12 +154,31 @@ private:
     // lua path variable for require() function
     static std::string lua_requirepath;
     static std::string lua_requirecpath;
+    // Folders of the script tree in the order package.path used to list them
+    static std::vector<std::string> lua_scriptfolders;
+    // Lua modules in the script tree, replaced on every scan. States keep the one they were loaded with.
+    static std::shared_ptr<const ModuleIndex> lua_modules;
+
+    // Per map Lua states when Eluna.MultiState is enabled.
+    // Lookups happen from every map thread, so the list has its own reader/writer lock.
+    static MapStateList mapStates;
+    static std::shared_mutex mapStatesLock;
+
+    // The map this state handles hooks for, NULL for the world state
+    Map* const boundMap;
+    // Built off the world thread by an async reload, until it is adopted by the world state
+    bool const staged;
+    std::shared_ptr<const ModuleIndex> moduleIndex;
+    // Lock of a map or staged state. The world state uses the static lock instead.
+    // Lock order is map state -> world state, never the other way around.
+    LockType stateLock;
 
     // A counter for lua event stacks that occur (see event_level).
     // This is used to determine whether an object belongs to the current call stack or not.
     // 0 is reserved for always belonging to the call stack
     // 1 is reserved for a non valid callstackid
-    uint64 callstackid = 2;
+    // Objects pushed to Lua point to the counter, it moves along with the Lua state on an async reload.
+    std::unique_ptr<uint64> callstackid;
     // A counter for the amount of nested events. When the event_level
     // reaches 0 we are about to return back to C++. At this point the
     // objects used during the event stack are invalidated.
@@ -146,13 +186,15 @@ private:
     // When a hook pushes arguments to be passed to event handlers,
     //  this is used to keep track of how many arguments were pushed.
     uint8 push_counter;
+    // Which callback source runs first on the next budgeted update
+    uint32 callbackRound;
 
     // Map from instance ID -> Lua table ref
     std::unordered_map<uint32, int> instanceDataRefs;
     // Map from map ID -> Lua table ref
     std::unordered_map<uint32, int> continentDataRefs;
 
-    Eluna();
+    Eluna(Map* map = NULL, bool isStaged = false);
     ~Eluna();
 
     // Prevent copy
@@ -164,20 +206,43 @@ private:
     void DestroyBindStores();
     void CreateBindStores();
     void InvalidateObjects();
+    // Runs due timed events, HTTP responses and query callbacks within Eluna.UpdateBudget
+    void UpdateCallbacks(uint32 diff);
 
     // Use ReloadEluna() to make eluna reload
     // This is called on world update to reload eluna
     static void _ReloadEluna();
+    // Builds a new world state for an async reload, returns NULL if any script failed
+    static Eluna* BuildStagedState();
+    // Swaps in the state built by an async reload once it is done, called on world update
+    static void UpdateAsyncReload();
+    // Takes over the Lua state, bindings and global timed events of `staged`
+    void AdoptState(Eluna* staged);
     static void LoadScriptPaths();
+    // Extensions first, then scripts, each sorted by path
+    static void GetScriptList(ScriptList& scripts);
+    // Reloads only the scripts changed since they were loaded, together with the scripts requiring them
+    static void ReloadChangedScripts();
+    bool ReloadModules(const ScriptList& scripts, std::unordered_set<std::string> reloaded);
+    // Loads and runs a single script, storing its result in package.loaded at stack index `modules`
+    bool RunScript(const LuaScript& script, int modules, uint32* compiledCount, uint32* cachedCount, uint32* precompiledCount);
     static void GetScripts(std::string path);
+    static void BuildModuleIndex();
+    // package.searchers entry resolving modules through the module index
+    static int SearchModule(lua_State* L);
     static void AddScriptPath(std::string filename, const std::string& fullpath);
     static int LoadCompiledScript(lua_State* L, const std::string& filepath);
-    static std::time_t GetFileModTime(const std::string& filepath);
-    static std::time_t GetFileModTimeWithCache(const std::string& filepath);
+    // Modification time in nanoseconds, 0 if the file can't be read
+    static uint64 GetFileModTime(const std::string& filepath);
+    static uint64 GetFileModTimeWithCache(const std::string& filepath);
     
     // Global cache management
     static bool CompileScriptToGlobalCache(const std::string& filepath);
     static bool CompileMoonScriptToGlobalCache(const std::string& filepath);
+    // `compiler` is created on first use and can be reused for more scripts
+    static bool CompileToGlobalCache(lua_State*& compiler, const std::string& filepath, bool isMoonScript);
+    // Compiles scripts missing from the global cache on worker threads, returns the number compiled
+    static uint32 CompileScripts(const ScriptList& scripts);
     static int TryLoadFromGlobalCache(lua_State* L, const std::string& filepath);
     static int LoadScriptWithCache(lua_State* L, const std::string& filepath, bool isMoonScript, uint32* compiledCount = nullptr, uint32* cachedCount = nullptr);
     static void ClearGlobalCache();
@@ -236,8 +301,9 @@ public:
     lua_State* L;
     EventMgr* eventMgr;
     HttpManager httpManager;
-    QueryCallbackProcessor queryProcessor;
+    ElunaQueryProcessor queryProcessor;
     EventEmitter<void(std::string)> OnError;
+    ElunaScriptModules scriptModules;
 
     BindingMap< EventKey<Hooks::ServerEvents> >*        ServerEventBindings;
     BindingMap< EventKey<Hooks::PlayerEvents> >*        PlayerEventBindings;
@@ -268,6 +334,30 @@ public:
     static void ReloadEluna() { LOCK_ELUNA; reload = true; }
     static LockType& GetLock() { return lock; };
     static bool IsInitialized() { return initialized; }
+    static bool IsMultistate() { return multistate; }
+
+    /*
+     * Returns the state handling hooks for `map`. Map states are created on first use.
+     * Returns the world state when multistate is disabled.
+     */
+    static Eluna* GetMapState(Map* map);
+    // Same as GetMapState, but returns NULL instead of creating a missing map state
+    static Eluna* FindMapState(Map* map);
+    static void DestroyMapState(Map* map);
+
+    /*
+     * Returns the state that owns `obj`: the world state for players,
+     * otherwise the state of the map the object is on.
+     */
+    static Eluna* GetStateFor(WorldObject const* obj);
+
+    LockType& GetStateLock() { return boundMap || staged ? stateLock : lock; }
+    // Built by an async reload and not swapped in yet, its callbacks can't run
+    bool IsStaged() const { return staged; }
+    bool IsMapState() const { return boundMap != NULL; }
+    Map* GetBoundMap() const { return boundMap; }
+    int32 GetBoundMapId() const;
+    uint32 GetBoundInstanceId() const;
     // Never returns nullptr
     static Eluna* GetEluna(lua_State* L)
     {
@@ -308,7 +398,8 @@ public:
         ElunaTemplate<T>::Push(luastate, ptr);
     }
 
-    static std::string FormatQuery(lua_State* L, const char* query);
+    // Replaces the placeholders of the query with the arguments from firstArg up
+    static std::string FormatQuery(lua_State* L, const char* query, int firstArg = 2);
 
     bool ExecuteCall(int params, int res);
 
@@ -336,10 +427,12 @@ public:
      */
     void PushInstanceData(lua_State* L, ElunaInstanceAI* ai, bool incrementCounter = true);
 
-    void RunScripts();
+    // Returns false if any script failed to load or run
+    bool RunScripts();
     bool ShouldReload() const { return reload; }
     bool HasLuaState() const { return L != NULL; }
-    uint64 GetCallstackId() const { return callstackid; }
+    uint64 GetCallstackId() const { return *callstackid; }
+    const uint64* GetCallstackCounter() const { return callstackid.get(); }
     int Register(lua_State* L, uint8 reg, uint32 entry, ObjectGuid guid, uint32 instanceId, uint32 event_id, int functionRef, uint32 shots);
 
     // Checks
@@ -355,6 +448,8 @@ public:
     static ElunaObject* CHECKTYPE(lua_State* luastate, int narg, const char *tname, bool error = true);
 
     CreatureAI* GetAI(Creature* creature);
+    uint64 GetCreatureBindingMask(Creature const* creature);
+    uint32 GetCreatureBindingGeneration() const;
     InstanceData* GetInstanceData(Map* map);
     void FreeInstanceId(uint32 instanceId);
 
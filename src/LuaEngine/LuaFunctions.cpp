@@ -27,6 +27,11 @@ extern "C"
 #include "GuildMethods.h"
 #include "GameObjectMethods.h"
 #include "ElunaQueryMethods.h"
+#include "ElunaStatementMethods.h"
+#include "ElunaTransactionMethods.h"
+#include "ElunaBulkInsertMethods.h"
+#include "ElunaWriteBehindMethods.h"
+#include "HttpResponseMethods.h"
 #include "AuraMethods.h"
 #include "ItemMethods.h"
 #include "WorldPacketMethods.h"
@@ -161,6 +166,25 @@ luaL_Reg GlobalMethods[] =
     { "AuthDBQuery", &LuaGlobalFunctions::AuthDBQuery },
     { "AuthDBQueryAsync", &LuaGlobalFunctions::AuthDBQueryAsync },
     { "AuthDBExecute", &LuaGlobalFunctions::AuthDBExecute },
+    { "WorldDBQueryCached", &LuaGlobalFunctions::WorldDBQueryCached },
+    { "CharDBQueryCached", &LuaGlobalFunctions::CharDBQueryCached },
+    { "AuthDBQueryCached", &LuaGlobalFunctions::AuthDBQueryCached },
+    { "InvalidateQueryCache", &LuaGlobalFunctions::InvalidateQueryCache },
+    { "WorldDBQueryStream", &LuaGlobalFunctions::WorldDBQueryStream },
+    { "CharDBQueryStream", &LuaGlobalFunctions::CharDBQueryStream },
+    { "AuthDBQueryStream", &LuaGlobalFunctions::AuthDBQueryStream },
+    { "WorldDBPrepare", &LuaGlobalFunctions::WorldDBPrepare },
+    { "CharDBPrepare", &LuaGlobalFunctions::CharDBPrepare },
+    { "AuthDBPrepare", &LuaGlobalFunctions::AuthDBPrepare },
+    { "WorldDBBeginTransaction", &LuaGlobalFunctions::WorldDBBeginTransaction },
+    { "CharDBBeginTransaction", &LuaGlobalFunctions::CharDBBeginTransaction },
+    { "AuthDBBeginTransaction", &LuaGlobalFunctions::AuthDBBeginTransaction },
+    { "WorldDBBulkInsert", &LuaGlobalFunctions::WorldDBBulkInsert },
+    { "CharDBBulkInsert", &LuaGlobalFunctions::CharDBBulkInsert },
+    { "AuthDBBulkInsert", &LuaGlobalFunctions::AuthDBBulkInsert },
+    { "WorldDBWriteBehind", &LuaGlobalFunctions::WorldDBWriteBehind },
+    { "CharDBWriteBehind", &LuaGlobalFunctions::CharDBWriteBehind },
+    { "AuthDBWriteBehind", &LuaGlobalFunctions::AuthDBWriteBehind },
     { "CreateLuaEvent", &LuaGlobalFunctions::CreateLuaEvent },
     { "RemoveEventById", &LuaGlobalFunctions::RemoveEventById },
     { "RemoveEvents", &LuaGlobalFunctions::RemoveEvents },
@@ -179,6 +203,10 @@ luaL_Reg GlobalMethods[] =
     { "StartGameEvent", &LuaGlobalFunctions::StartGameEvent },
     { "StopGameEvent", &LuaGlobalFunctions::StopGameEvent },
     { "HttpRequest", &LuaGlobalFunctions::HttpRequest },
+    { "GetHttpRequestStats", &LuaGlobalFunctions::GetHttpRequestStats },
+    { "GetHttpCacheStats", &LuaGlobalFunctions::GetHttpCacheStats },
+    { "GetQueryCacheStats", &LuaGlobalFunctions::GetQueryCacheStats },
+    { "GetPendingCallbacks", &LuaGlobalFunctions::GetPendingCallbacks },
     { "SetOwnerHalaa", &LuaGlobalFunctions::SetOwnerHalaa },
     { "LookupEntry", &LuaGlobalFunctions::LookupEntry },
 
@@ -1222,6 +1250,8 @@ ElunaRegister<ElunaQuery> QueryMethods[] =
     { "GetColumnCount", &LuaQuery::GetColumnCount },
     { "GetRowCount", &LuaQuery::GetRowCount },
     { "GetRow", &LuaQuery::GetRow },
+    { "GetRows", &LuaQuery::GetRows },
+    { "GetColumns", &LuaQuery::GetColumns },
     { "GetBool", &LuaQuery::GetBool },
     { "GetUInt8", &LuaQuery::GetUInt8 },
     { "GetUInt16", &LuaQuery::GetUInt16 },
@@ -1239,6 +1269,91 @@ ElunaRegister<ElunaQuery> QueryMethods[] =
     { "NextRow", &LuaQuery::NextRow },
     { "IsNull", &LuaQuery::IsNull },
 
+    // Other
+    { "Rows", &LuaQuery::Rows },
+
+    { NULL, NULL }
+};
+
+ElunaRegister<ElunaStatement> StatementMethods[] =
+{
+    // Getters
+    { "GetParameterCount", &LuaStatement::GetParameterCount },
+
+    // Setters
+    { "SetBool", &LuaStatement::SetBool },
+    { "SetUInt8", &LuaStatement::SetUInt8 },
+    { "SetUInt16", &LuaStatement::SetUInt16 },
+    { "SetUInt32", &LuaStatement::SetUInt32 },
+    { "SetUInt64", &LuaStatement::SetUInt64 },
+    { "SetInt8", &LuaStatement::SetInt8 },
+    { "SetInt16", &LuaStatement::SetInt16 },
+    { "SetInt32", &LuaStatement::SetInt32 },
+    { "SetInt64", &LuaStatement::SetInt64 },
+    { "SetFloat", &LuaStatement::SetFloat },
+    { "SetDouble", &LuaStatement::SetDouble },
+    { "SetString", &LuaStatement::SetString },
+    { "SetBinary", &LuaStatement::SetBinary },
+    { "SetNull", &LuaStatement::SetNull },
+
+    // Other
+    { "ClearParameters", &LuaStatement::ClearParameters },
+    { "Query", &LuaStatement::Query },
+    { "QueryAsync", &LuaStatement::QueryAsync },
+    { "Execute", &LuaStatement::Execute },
+
+    { NULL, NULL }
+};
+
+ElunaRegister<ElunaTransaction> TransactionMethods[] =
+{
+    // Getters
+    { "GetSize", &LuaTransaction::GetSize },
+
+    // Other
+    { "Append", &LuaTransaction::Append },
+    { "Clear", &LuaTransaction::Clear },
+    { "Commit", &LuaTransaction::Commit },
+
+    { NULL, NULL }
+};
+
+ElunaRegister<ElunaBulkInsert> BulkInsertMethods[] =
+{
+    // Getters
+    { "GetColumnCount", &LuaBulkInsert::GetColumnCount },
+    { "GetRowCount", &LuaBulkInsert::GetRowCount },
+
+    // Other
+    { "AddRow", &LuaBulkInsert::AddRow },
+    { "Clear", &LuaBulkInsert::Clear },
+    { "Execute", &LuaBulkInsert::Execute },
+
+    { NULL, NULL }
+};
+
+ElunaRegister<ElunaWriteBehind> WriteBehindMethods[] =
+{
+    // Getters
+    { "GetKeyColumns", &LuaWriteBehind::GetKeyColumns },
+    { "GetDirtyCount", &LuaWriteBehind::GetDirtyCount },
+
+    // Other
+    { "Set", &LuaWriteBehind::Set },
+    { "Flush", &LuaWriteBehind::Flush },
+
+    { NULL, NULL }
+};
+
+ElunaRegister<HttpResponse> HttpResponseMethods[] =
+{
+    // Getters
+    { "GetStatus", &LuaHttpResponse::GetStatus },
+    { "GetText", &LuaHttpResponse::GetText },
+    { "GetSize", &LuaHttpResponse::GetSize },
+    { "GetHeader", &LuaHttpResponse::GetHeader },
+    { "GetHeaders", &LuaHttpResponse::GetHeaders },
+
     { NULL, NULL }
 };
 
@@ -1917,6 +2032,21 @@ void RegisterFunctions(Eluna* E)
     ElunaTemplate<ElunaQuery>::Register(E, "ElunaQuery", true);
     ElunaTemplate<ElunaQuery>::SetMethods(E, QueryMethods);
 
+    ElunaTemplate<ElunaStatement>::Register(E, "ElunaStatement", true);
+    ElunaTemplate<ElunaStatement>::SetMethods(E, StatementMethods);
+
+    ElunaTemplate<ElunaTransaction>::Register(E, "ElunaTransaction", true);
+    ElunaTemplate<ElunaTransaction>::SetMethods(E, TransactionMethods);
+
+    ElunaTemplate<ElunaBulkInsert>::Register(E, "ElunaBulkInsert", true);
+    ElunaTemplate<ElunaBulkInsert>::SetMethods(E, BulkInsertMethods);
+
+    ElunaTemplate<ElunaWriteBehind>::Register(E, "ElunaWriteBehind", true);
+    ElunaTemplate<ElunaWriteBehind>::SetMethods(E, WriteBehindMethods);
+
+    ElunaTemplate<HttpResponse>::Register(E, "HttpResponse", true);
+    ElunaTemplate<HttpResponse>::SetMethods(E, HttpResponseMethods);
+
     ElunaTemplate<AchievementEntry>::Register(E, "AchievementEntry");
     ElunaTemplate<AchievementEntry>::SetMethods(E, AchievementMethods);
 
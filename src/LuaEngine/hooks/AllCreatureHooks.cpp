@@ -19,7 +19,7 @@ using namespace Hooks;
     auto key = EventKey<AllCreatureEvents>(EVENT);\
     if (!AllCreatureEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 #define START_HOOK_WITH_RETVAL(EVENT, RETVAL) \
     if (!ElunaConfig::GetInstance().IsElunaEnabled())\
@@ -27,7 +27,7 @@ using namespace Hooks;
     auto key = EventKey<AllCreatureEvents>(EVENT);\
     if (!AllCreatureEventBindings->HasBindingsFor(key))\
         return RETVAL;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 void Eluna::OnAllCreatureAddToWorld(Creature* creature)
 {
@@ -18,7 +18,7 @@ using namespace Hooks;
     auto key = EventKey<GroupEvents>(EVENT);\
     if (!GroupEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 void Eluna::OnAddMember(Group* group, ObjectGuid guid)
 {
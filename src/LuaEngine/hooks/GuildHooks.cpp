@@ -18,7 +18,7 @@ using namespace Hooks;
     auto key = EventKey<GuildEvents>(EVENT);\
     if (!GuildEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 void Eluna::OnAddMember(Guild* guild, Player* player, uint32 plRank)
 {
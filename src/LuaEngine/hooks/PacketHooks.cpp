@@ -19,7 +19,7 @@ using namespace Hooks;
     auto key = EventKey<ServerEvents>(EVENT);\
     if (!ServerEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 #define START_HOOK_PACKET(EVENT, OPCODE) \
     if (!ElunaConfig::GetInstance().IsElunaEnabled())\
@@ -27,7 +27,7 @@ using namespace Hooks;
     auto key = EntryKey<PacketEvents>(EVENT, OPCODE);\
     if (!PacketEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 bool Eluna::OnPacketSend(WorldSession* session, const WorldPacket& packet)
 {
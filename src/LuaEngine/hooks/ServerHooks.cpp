@@ -20,7 +20,7 @@ using namespace Hooks;
     auto key = EventKey<ServerEvents>(EVENT);\
     if (!ServerEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 #define START_HOOK_WITH_RETVAL(EVENT, RETVAL) \
     if (!ElunaConfig::GetInstance().IsElunaEnabled())\
@@ -28,7 +28,7 @@ using namespace Hooks;
     auto key = EventKey<ServerEvents>(EVENT);\
     if (!ServerEventBindings->HasBindingsFor(key))\
         return RETVAL;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 bool Eluna::OnAddonMessage(Player* sender, uint32 type, std::string& msg, Player* receiver, Guild* guild, Group* group, Channel* channel)
 {
@@ -66,7 +66,7 @@ bool Eluna::OnAddonMessage(Player* sender, uint32 type, std::string& msg, Player
 
 void Eluna::OnTimedEvent(int funcRef, uint32 delay, uint32 calls, WorldObject* obj)
 {
-    LOCK_ELUNA;
+    LOCK_ELUNA_STATE;
     ASSERT(!event_level);
 
     // Get function
@@ -251,15 +251,18 @@ void Eluna::OnShutdownCancel()
 
 void Eluna::OnWorldUpdate(uint32 diff)
 {
+    bool reloadRequested;
     {
         LOCK_ELUNA;
-        if (ShouldReload())
-            _ReloadEluna();
+        UpdateAsyncReload();
+        reloadRequested = ShouldReload();
     }
 
-    eventMgr->globalProcessor->Update(diff);
-    httpManager.HandleHttpResponses();
-    queryProcessor.ProcessReadyCallbacks();
+    // Not under the world lock, the reload locks the map states first
+    if (reloadRequested)
+        _ReloadEluna();
+
+    UpdateCallbacks(diff);
 
     START_HOOK(WORLD_EVENT_ON_UPDATE);
     Push(diff);
@@ -311,9 +314,11 @@ void Eluna::OnPlayerLeave(Map* map, Player* player)
 
 void Eluna::OnUpdate(Map* map, uint32 diff)
 {
+    // Map states are updated by their map instead of the world
+    if (IsMapState())
+        UpdateCallbacks(diff);
+
     START_HOOK(MAP_EVENT_ON_UPDATE);
-    // enable this for multithread
-    // eventMgr->globalProcessor->Update(diff);
     Push(map);
     Push(diff);
     CallAllFunctions(ServerEventBindings, key);
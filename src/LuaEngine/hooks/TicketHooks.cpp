@@ -19,7 +19,7 @@ using namespace Hooks;
     auto key = EventKey<TicketEvents>(EVENT);\
     if (!TicketEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 #define START_HOOK(EVENT) \
     if (!ElunaConfig::GetInstance().IsElunaEnabled())\
@@ -27,7 +27,7 @@ using namespace Hooks;
     auto key = EventKey<TicketEvents>(EVENT);\
     if (!TicketEventBindings->HasBindingsFor(key))\
         return;\
-    LOCK_ELUNA
+    LOCK_ELUNA_STATE
 
 void Eluna::OnTicketCreate(GmTicket* ticket)
 {
@@ -0,0 +1,129 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef BULKINSERTMETHODS_H
+#define BULKINSERTMETHODS_H
+
+#include "ElunaTransaction.h"
+
+/***
+ * Rows for one table, sent as a few multi-row INSERT statements instead of one query per row.
+ *
+ * E.g. the return value of [Global:CharDBBulkInsert].
+ *
+ *     local log = CharDBBulkInsert("my_loot_log", { "guid", "item", "count" })
+ *     for _, loot in ipairs(drops) do
+ *         log:AddRow(loot.guid, loot.item, loot.count)
+ *     end
+ *     log:Execute()
+ *
+ * Inherits all methods from: none
+ */
+namespace LuaBulkInsert
+{
+    // Writes the value at index as a SQL literal, returns false if it has no SQL equivalent
+    static bool FormatValue(lua_State* L, int index, std::string& literal)
+    {
+        switch (lua_type(L, index))
+        {
+            case LUA_TNIL:
+                literal = "NULL";
+                return true;
+            case LUA_TBOOLEAN:
+                literal = lua_toboolean(L, index) ? "1" : "0";
+                return true;
+            case LUA_TNUMBER:
+                literal = ElunaStatement::FormatNumber(lua_tonumber(L, index));
+                return true;
+            case LUA_TSTRING:
+            {
+                size_t length = 0;
+                const char* value = lua_tolstring(L, index, &length);
+                literal = ElunaStatement::FormatString(value, length);
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Returns the number of columns each row has.
+     *
+     * @return uint32 columnCount
+     */
+    int GetColumnCount(lua_State* L, ElunaBulkInsert* bulk)
+    {
+        Eluna::Push(L, bulk->GetColumnCount());
+        return 1;
+    }
+
+    /**
+     * Returns the number of rows added since the last [ElunaBulkInsert:Execute].
+     *
+     * @return uint32 rowCount
+     */
+    int GetRowCount(lua_State* L, ElunaBulkInsert* bulk)
+    {
+        Eluna::Push(L, bulk->GetRowCount());
+        return 1;
+    }
+
+    /**
+     * Adds a row, with one value for each column in the order they were given.
+     *
+     * Numbers, strings and booleans are written as SQL values and `nil` as `NULL`.
+     *
+     * @param ... values
+     */
+    int AddRow(lua_State* L, ElunaBulkInsert* bulk)
+    {
+        uint32 count = bulk->GetColumnCount();
+        if (uint32(lua_gettop(L) - 1) != count)
+            return luaL_error(L, "row has %d values, expected %d", lua_gettop(L) - 1, int(count));
+
+        std::vector<std::string> values(count);
+        for (int i = 2; i < int(count) + 2; ++i)
+            if (!FormatValue(L, i, values[i - 2]))
+                return luaL_argerror(L, i, "number, string, boolean or nil expected");
+
+        bulk->AddRow(values);
+        return 0;
+    }
+
+    /**
+     * Removes all rows added since the last [ElunaBulkInsert:Execute].
+     */
+    int Clear(lua_State* /*L*/, ElunaBulkInsert* bulk)
+    {
+        bulk->Clear();
+        return 0;
+    }
+
+    /**
+     * Inserts the rows added so far as one transaction, then removes them from the builder.
+     *
+     * Works like [ElunaTransaction:Commit]. To insert the rows together with other
+     *   queries, pass the builder to [ElunaTransaction:Append] instead.
+     *
+     * @param function callback = nil : function called with `true` or `false` when the insert has finished
+     * @return bool committed : `false` if there were no rows, the callback is not called then
+     */
+    int Execute(lua_State* L, ElunaBulkInsert* bulk)
+    {
+        // Checked before the rows are taken, so a bad argument does not lose them
+        if (!lua_isnoneornil(L, 2))
+            luaL_checktype(L, 2, LUA_TFUNCTION);
+
+        ElunaTransaction trans(bulk->GetDatabase());
+        bulk->Flush(trans);
+
+        Eluna::Push(L, LuaTransaction::CommitTransaction(L, trans, 2));
+        return 1;
+    }
+}
+
+#endif
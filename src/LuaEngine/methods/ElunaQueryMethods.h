@@ -7,7 +7,7 @@
 #ifndef QUERYMETHODS_H
 #define QUERYMETHODS_H
 
-#define RESULT  (*result)
+#include "ElunaQuery.h"
 
 /***
  * The result of a database query.
@@ -21,13 +21,51 @@ namespace LuaQuery
     static void CheckFields(lua_State* L, ElunaQuery* result)
     {
         uint32 field = Eluna::CHECKVAL<uint32>(L, 2);
-        uint32 count = RESULT->GetFieldCount();
+        uint32 count = result->GetFieldCount();
         if (field >= count)
         {
             char arr[256];
             snprintf(arr, sizeof(arr), "trying to access invalid field index %u. There are %u fields available and the indexes start from 0", field, count);
             luaL_argerror(L, 2, arr);
         }
+
+        if (!result->HasRow())
+            luaL_error(L, "there is no current row, NextRow has returned false");
+    }
+
+    // Pushes a value the way GetRow returns it, numbers for numeric columns, nil for NULL and strings for the rest
+    static void PushField(lua_State* L, ElunaQuery* result, uint32 index)
+    {
+        if (result->IsNull(index))
+        {
+            Eluna::Push(L);
+            return;
+        }
+
+        // MYSQL_TYPE_LONGLONG Interpreted as string for lua
+        std::string value = result->Get<std::string>(index);
+        if (result->IsNumeric(index))
+            Eluna::Push(L, strtod(value.c_str(), NULL));
+        else
+            Eluna::Push(L, value);
+    }
+
+    // Pushes every field name once so rows can copy them instead of creating them again, returns the index of the first
+    static int PushFieldNames(lua_State* L, ElunaQuery* result)
+    {
+        uint32 col = result->GetFieldCount();
+        luaL_checkstack(L, col + 4, "too many columns");
+
+        int first = lua_gettop(L) + 1;
+        for (uint32 i = 0; i < col; ++i)
+            Eluna::Push(L, result->GetFieldName(i));
+        return first;
+    }
+
+    // Upper bound of the rows left, used to size the arrays
+    static int RowsLeft(ElunaQuery* result)
+    {
+        return int(std::min<uint64>(result->GetRowCount(), 1 << 24));
     }
 
     /**
@@ -41,7 +79,7 @@ namespace LuaQuery
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
 
-        Eluna::Push(L, RESULT->Fetch()[col].IsNull());
+        Eluna::Push(L, result->IsNull(col));
         return 1;
     }
 
@@ -52,7 +90,7 @@ namespace LuaQuery
      */
     int GetColumnCount(lua_State* L, ElunaQuery* result)
     {
-        Eluna::Push(L, RESULT->GetFieldCount());
+        Eluna::Push(L, result->GetFieldCount());
         return 1;
     }
 
@@ -63,10 +101,10 @@ namespace LuaQuery
      */
     int GetRowCount(lua_State* L, ElunaQuery* result)
     {
-        if (RESULT->GetRowCount() > (uint32)-1)
+        if (result->GetRowCount() > (uint32)-1)
             Eluna::Push(L, (uint32)-1);
         else
-            Eluna::Push(L, (uint32)(RESULT->GetRowCount()));
+            Eluna::Push(L, (uint32)(result->GetRowCount()));
         return 1;
     }
 
@@ -80,7 +118,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<bool>());
+        Eluna::Push(L, result->Get<bool>(col));
         return 1;
     }
 
@@ -94,7 +132,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<uint8>());
+        Eluna::Push(L, result->Get<uint8>(col));
         return 1;
     }
 
@@ -108,7 +146,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<uint16>());
+        Eluna::Push(L, result->Get<uint16>(col));
         return 1;
     }
 
@@ -122,7 +160,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<uint32>());
+        Eluna::Push(L, result->Get<uint32>(col));
         return 1;
     }
 
@@ -136,7 +174,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<uint64>());
+        Eluna::Push(L, result->Get<uint64>(col));
         return 1;
     }
 
@@ -150,7 +188,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<int8>());
+        Eluna::Push(L, result->Get<int8>(col));
         return 1;
     }
 
@@ -164,7 +202,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<int16>());
+        Eluna::Push(L, result->Get<int16>(col));
         return 1;
     }
 
@@ -178,7 +216,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<int32>());
+        Eluna::Push(L, result->Get<int32>(col));
         return 1;
     }
 
@@ -192,7 +230,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<int64>());
+        Eluna::Push(L, result->Get<int64>(col));
         return 1;
     }
 
@@ -206,7 +244,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<float>());
+        Eluna::Push(L, result->Get<float>(col));
         return 1;
     }
 
@@ -220,7 +258,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<double>());
+        Eluna::Push(L, result->Get<double>(col));
         return 1;
     }
 
@@ -234,7 +272,7 @@ namespace LuaQuery
     {
         uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
         CheckFields(L, result);
-        Eluna::Push(L, RESULT->Fetch()[col].Get<std::string>());
+        Eluna::Push(L, result->Get<std::string>(col));
         return 1;
     }
 
@@ -249,7 +287,7 @@ namespace LuaQuery
      */
     int NextRow(lua_State* L, ElunaQuery* result)
     {
-        Eluna::Push(L, RESULT->NextRow());
+        Eluna::Push(L, result->NextRow());
         return 1;
     }
 
@@ -272,45 +310,220 @@ namespace LuaQuery
      */
     int GetRow(lua_State* L, ElunaQuery* result)
     {
-        uint32 col = RESULT->GetFieldCount();
-        Field* row = RESULT->Fetch();
+        if (!result->HasRow())
+            return luaL_error(L, "there is no current row, NextRow has returned false");
+
+        uint32 col = result->GetFieldCount();
 
         lua_createtable(L, 0, col);
         int tbl = lua_gettop(L);
 
         for (uint32 i = 0; i < col; ++i)
         {
-            Eluna::Push(L, RESULT->GetFieldName(i));
+            Eluna::Push(L, result->GetFieldName(i));
+            PushField(L, result, i);
+            lua_rawset(L, tbl);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
 
-            std::string _str = row[i].Get<std::string>();
-            const char* str = _str.c_str();
-            if (row[i].IsNull() || !str)
-                Eluna::Push(L);
-            else
+    // Pushes an array with a table for each row from the current one, at most maxRows, and leaves the result at the row after them
+    static uint32 PushRows(lua_State* L, ElunaQuery* result, uint32 maxRows)
+    {
+        // The field names are freed with the last row
+        if (!result->HasRow())
+        {
+            lua_newtable(L);
+            return 0;
+        }
+
+        uint32 col = result->GetFieldCount();
+        int names = PushFieldNames(L, result);
+
+        lua_createtable(L, int(std::min<uint32>(RowsLeft(result), maxRows)), 0);
+        int rows = lua_gettop(L);
+
+        uint32 count = 0;
+        do
+        {
+            lua_createtable(L, 0, col);
+            for (uint32 i = 0; i < col; ++i)
             {
-                // MYSQL_TYPE_LONGLONG Interpreted as string for lua
-                switch (row[i].GetType())
-                {
-                    case DatabaseFieldTypes::Int8:
-                    case DatabaseFieldTypes::Int16:
-                    case DatabaseFieldTypes::Int32:
-                    case DatabaseFieldTypes::Int64:
-                    case DatabaseFieldTypes::Float:
-                    case DatabaseFieldTypes::Double:
-                        Eluna::Push(L, strtod(str, NULL));
-                        break;
-                    default:
-                        Eluna::Push(L, str);
-                        break;
-                }
+                lua_pushvalue(L, names + i);
+                PushField(L, result, i);
+                lua_rawset(L, -3);
             }
-            lua_rawset(L, tbl);
+            lua_rawseti(L, rows, ++count);
+        } while (result->NextRow() && count < maxRows);
+
+        lua_insert(L, names);
+        lua_settop(L, names);
+        return count;
+    }
+
+    /**
+     * Returns an array with a table for each row from the current one to the last, like [ElunaQuery:GetRow] returns them.
+     *
+     * This is much faster than reading the rows one field at a time. Afterwards the
+     *   [ElunaQuery] is past its last row and has no current row to read.
+     *   With `maxRows`, the [ElunaQuery] is left at the first row that was not returned,
+     *   so a large result can be read in parts.
+     *
+     *     local query = WorldDBQuery("SELECT entry, name FROM creature_template")
+     *     if query then
+     *         for i, row in ipairs(query:GetRows()) do
+     *             print(row.entry, row.name)
+     *         end
+     *     end
+     *
+     * @param uint32 maxRows = nil : most rows to return, all rows left if nil
+     * @return table rows : array of tables where `T[i][column] = data`
+     */
+    int GetRows(lua_State* L, ElunaQuery* result)
+    {
+        uint32 maxRows = Eluna::CHECKVAL<uint32>(L, 2, 0);
+        if (!lua_isnoneornil(L, 2) && !maxRows)
+            return luaL_argerror(L, 2, "maxRows must be greater than 0");
+
+        PushRows(L, result, maxRows ? maxRows : (uint32)-1);
+        return 1;
+    }
+
+    /**
+     * Returns a table with an array of values for each column, for the rows from the current one to the last.
+     *
+     * Values are converted like [ElunaQuery:GetRow] does. `NULL` values leave holes in the
+     *   arrays, so use the returned row count instead of the `#` operator.
+     *   Afterwards the [ElunaQuery] is past its last row and has no current row to read.
+     *
+     *     local query = WorldDBQuery("SELECT entry, name FROM creature_template")
+     *     if query then
+     *         local columns, count = query:GetColumns()
+     *         for i = 1, count do
+     *             print(columns.entry[i], columns.name[i])
+     *         end
+     *     end
+     *
+     * @return table columns : table of arrays where `T[column][i] = data`
+     * @return uint32 rowCount : number of rows read
+     */
+    int GetColumns(lua_State* L, ElunaQuery* result)
+    {
+        // The field names are freed with the last row
+        if (!result->HasRow())
+        {
+            lua_newtable(L);
+            Eluna::Push(L, 0);
+            return 2;
         }
 
-        lua_settop(L, tbl);
+        uint32 col = result->GetFieldCount();
+        int names = PushFieldNames(L, result);
+        int size = RowsLeft(result);
+
+        // The arrays stay on the stack while they are filled and are added to the result at the end
+        luaL_checkstack(L, col + 3, "too many columns");
+        lua_createtable(L, 0, col);
+        int columns = lua_gettop(L);
+        for (uint32 i = 0; i < col; ++i)
+            lua_createtable(L, size, 0);
+
+        uint32 count = 0;
+        do
+        {
+            ++count;
+            for (uint32 i = 0; i < col; ++i)
+            {
+                if (result->IsNull(i))
+                    continue;
+
+                PushField(L, result, i);
+                lua_rawseti(L, columns + 1 + i, count);
+            }
+        } while (result->NextRow());
+
+        for (uint32 i = 0; i < col; ++i)
+        {
+            lua_pushvalue(L, names + i);
+            lua_pushvalue(L, columns + 1 + i);
+            lua_rawset(L, columns);
+        }
+
+        lua_settop(L, columns);
+        lua_insert(L, names);
+        lua_settop(L, names);
+        Eluna::Push(L, count);
+        return 2;
+    }
+
+    static int RowsIterator(lua_State* L)
+    {
+        ElunaQuery* result = static_cast<ElunaQuery*>(lua_touserdata(L, lua_upvalueindex(2)));
+
+        // The first call returns the current row, the ones after it advance first
+        if (lua_toboolean(L, lua_upvalueindex(4)))
+        {
+            if (!result->HasRow() || !result->NextRow())
+                return 0;
+        }
+        else
+        {
+            lua_pushboolean(L, 1);
+            lua_replace(L, lua_upvalueindex(4));
+            if (!result->HasRow())
+                return 0;
+        }
+
+        uint32 col = result->GetFieldCount();
+
+        lua_createtable(L, 0, col);
+        for (uint32 i = 0; i < col; ++i)
+        {
+            lua_rawgeti(L, lua_upvalueindex(3), i + 1);
+            PushField(L, result, i);
+            lua_rawset(L, -3);
+        }
+        return 1;
+    }
+
+    /**
+     * Returns an iterator over the rows from the current one to the last, for use in a generic `for` loop.
+     *
+     * Each row is a table like [ElunaQuery:GetRow] returns. Unlike [ElunaQuery:GetRows], only
+     *   one row is converted at a time, and the loop can stop early with the [ElunaQuery] at that row.
+     *
+     *     local query = CharDBQuery("SELECT guid, name FROM characters")
+     *     if query then
+     *         for row in query:Rows() do
+     *             print(row.guid, row.name)
+     *         end
+     *     end
+     *
+     * @return function iterator
+     */
+    int Rows(lua_State* L, ElunaQuery* result)
+    {
+        // The column names are created once and shared by every row
+        uint32 col = result->GetFieldCount();
+        lua_pushvalue(L, 1);
+        lua_pushlightuserdata(L, result);
+        lua_createtable(L, col, 0);
+        if (result->HasRow())
+        {
+            for (uint32 i = 0; i < col; ++i)
+            {
+                Eluna::Push(L, result->GetFieldName(i));
+                lua_rawseti(L, -2, i + 1);
+            }
+        }
+        lua_pushboolean(L, 0);
+
+        // The query userdata is an upvalue, so the result is not collected while the loop runs
+        lua_pushcclosure(L, &RowsIterator, 4);
         return 1;
     }
 };
-#undef RESULT
 
 #endif
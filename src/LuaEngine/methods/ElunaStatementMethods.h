@@ -0,0 +1,341 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef STATEMENTMETHODS_H
+#define STATEMENTMETHODS_H
+
+#include "ElunaStatement.h"
+
+/***
+ * A SQL query with `?` placeholders, declared once and run with different parameters.
+ *
+ * Parameter indexes start from 0. Values stay bound after the statement is run,
+ *   so only the ones that change need to be set again.
+ *
+ * E.g. the return value of [Global:CharDBPrepare].
+ *
+ *     local addKill = CharDBPrepare("UPDATE my_kills SET kills = kills + 1 WHERE guid = ?")
+ *
+ *     local function OnKill(event, killer, killed)
+ *         addKill:SetUInt32(0, killer:GetGUIDLow())
+ *         addKill:Execute()
+ *     end
+ *
+ * Inherits all methods from: none
+ */
+namespace LuaStatement
+{
+    static uint32 CheckIndex(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = Eluna::CHECKVAL<uint32>(L, 2);
+        uint32 count = stmt->GetParameterCount();
+        if (index >= count)
+        {
+            char arr[256];
+            snprintf(arr, sizeof(arr), "trying to set invalid parameter index %u. There are %u parameters and the indexes start from 0", index, count);
+            luaL_argerror(L, 2, arr);
+        }
+        return index;
+    }
+
+    static std::string BuildQuery(lua_State* L, ElunaStatement* stmt)
+    {
+        std::string sql;
+        uint32 missing = 0;
+        if (!stmt->Build(sql, missing))
+            luaL_error(L, "statement parameter %d has no value", int(missing));
+        return sql;
+    }
+
+    /**
+     * Returns the number of `?` placeholders in the statement.
+     *
+     * @return uint32 parameterCount
+     */
+    int GetParameterCount(lua_State* L, ElunaStatement* stmt)
+    {
+        Eluna::Push(L, stmt->GetParameterCount());
+        return 1;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a boolean, stored as 1 or 0.
+     *
+     * @param uint32 index
+     * @param bool value
+     */
+    int SetBool(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        bool value = Eluna::CHECKVAL<bool>(L, 3);
+        stmt->SetValue(index, value ? "1" : "0");
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to an unsigned 8-bit integer.
+     *
+     * @param uint32 index
+     * @param uint8 value
+     */
+    int SetUInt8(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatUnsigned(Eluna::CHECKVAL<uint8>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to an unsigned 16-bit integer.
+     *
+     * @param uint32 index
+     * @param uint16 value
+     */
+    int SetUInt16(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatUnsigned(Eluna::CHECKVAL<uint16>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to an unsigned 32-bit integer.
+     *
+     * @param uint32 index
+     * @param uint32 value
+     */
+    int SetUInt32(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatUnsigned(Eluna::CHECKVAL<uint32>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to an unsigned 64-bit integer.
+     *
+     * @param uint32 index
+     * @param uint64 value
+     */
+    int SetUInt64(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatUnsigned(Eluna::CHECKVAL<uint64>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a signed 8-bit integer.
+     *
+     * @param uint32 index
+     * @param int8 value
+     */
+    int SetInt8(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatInteger(Eluna::CHECKVAL<int8>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a signed 16-bit integer.
+     *
+     * @param uint32 index
+     * @param int16 value
+     */
+    int SetInt16(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatInteger(Eluna::CHECKVAL<int16>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a signed 32-bit integer.
+     *
+     * @param uint32 index
+     * @param int32 value
+     */
+    int SetInt32(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatInteger(Eluna::CHECKVAL<int32>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a signed 64-bit integer.
+     *
+     * @param uint32 index
+     * @param int64 value
+     */
+    int SetInt64(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatInteger(Eluna::CHECKVAL<int64>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a 32-bit floating point value.
+     *
+     * @param uint32 index
+     * @param float value
+     */
+    int SetFloat(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatFloat(Eluna::CHECKVAL<float>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a 64-bit floating point value.
+     *
+     * @param uint32 index
+     * @param double value
+     */
+    int SetDouble(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, ElunaStatement::FormatNumber(Eluna::CHECKVAL<double>(L, 3)));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to a string, the string is escaped and quoted.
+     *
+     * @param uint32 index
+     * @param string value
+     */
+    int SetString(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        size_t length = 0;
+        const char* value = luaL_checklstring(L, 3, &length);
+        stmt->SetValue(index, ElunaStatement::FormatString(value, length));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to the bytes of a string, for BLOB and BINARY columns.
+     *
+     * The bytes are sent as a hexadecimal literal, they may contain any value including zero.
+     *
+     * @param uint32 index
+     * @param string value
+     */
+    int SetBinary(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        size_t length = 0;
+        const char* value = luaL_checklstring(L, 3, &length);
+        stmt->SetValue(index, ElunaStatement::FormatBinary(value, length));
+        return 0;
+    }
+
+    /**
+     * Sets the parameter at the specified index to `NULL`.
+     *
+     * @param uint32 index
+     */
+    int SetNull(lua_State* L, ElunaStatement* stmt)
+    {
+        uint32 index = CheckIndex(L, stmt);
+        stmt->SetValue(index, "NULL");
+        return 0;
+    }
+
+    /**
+     * Removes the values of all parameters, they must be set again before the statement is run.
+     */
+    int ClearParameters(lua_State* /*L*/, ElunaStatement* stmt)
+    {
+        stmt->ClearValues();
+        return 0;
+    }
+
+    /**
+     * Runs the statement and returns an [ElunaQuery].
+     *
+     * The query is always executed synchronously, see [ElunaStatement:QueryAsync].
+     *
+     * @return [ElunaQuery] results or nil if no rows found
+     */
+    int Query(lua_State* L, ElunaStatement* stmt)
+    {
+        std::string sql = BuildQuery(L, stmt);
+
+        QueryResult result;
+        switch (stmt->GetDatabase())
+        {
+            case ElunaStatement::DATABASE_WORLD:
+                result = WorldDatabase.Query(sql);
+                break;
+            case ElunaStatement::DATABASE_CHARACTER:
+                result = CharacterDatabase.Query(sql);
+                break;
+            case ElunaStatement::DATABASE_LOGIN:
+                result = LoginDatabase.Query(sql);
+                break;
+        }
+
+        if (result)
+            Eluna::Push(L, new ElunaQuery(result));
+        else
+            Eluna::Push(L);
+        return 1;
+    }
+
+    /**
+     * Runs the statement asynchronously and passes an [ElunaQuery] to a callback function.
+     *
+     * The parameters are read when this is called, they can be set again right away.
+     *
+     * @param function callback : function that will be called when the results are available
+     */
+    int QueryAsync(lua_State* L, ElunaStatement* stmt)
+    {
+        std::string sql = BuildQuery(L, stmt);
+
+        switch (stmt->GetDatabase())
+        {
+            case ElunaStatement::DATABASE_WORLD:
+                return LuaGlobalFunctions::DBQueryAsync(L, WorldDatabase, sql, 2);
+            case ElunaStatement::DATABASE_CHARACTER:
+                return LuaGlobalFunctions::DBQueryAsync(L, CharacterDatabase, sql, 2);
+            case ElunaStatement::DATABASE_LOGIN:
+                return LuaGlobalFunctions::DBQueryAsync(L, LoginDatabase, sql, 2);
+        }
+        return 0;
+    }
+
+    /**
+     * Runs the statement, any results are ignored.
+     *
+     * The query may be executed *asynchronously* (at a later, unpredictable time).
+     */
+    int Execute(lua_State* L, ElunaStatement* stmt)
+    {
+        std::string sql = BuildQuery(L, stmt);
+
+        switch (stmt->GetDatabase())
+        {
+            case ElunaStatement::DATABASE_WORLD:
+                WorldDatabase.Execute(sql);
+                break;
+            case ElunaStatement::DATABASE_CHARACTER:
+                CharacterDatabase.Execute(sql);
+                break;
+            case ElunaStatement::DATABASE_LOGIN:
+                LoginDatabase.Execute(sql);
+                break;
+        }
+        return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef TRANSACTIONMETHODS_H
+#define TRANSACTIONMETHODS_H
+
+#include "ElunaTransaction.h"
+
+/***
+ * Queries committed together, either all of them are applied or none.
+ *
+ * E.g. the return value of [Global:CharDBBeginTransaction].
+ *
+ *     local trans = CharDBBeginTransaction()
+ *     trans:Append("UPDATE my_currency SET amount = amount - ? WHERE guid = ?", price, buyer)
+ *     trans:Append("UPDATE my_currency SET amount = amount + ? WHERE guid = ?", price, seller)
+ *     trans:Commit(function(success)
+ *         print("Trade saved: " .. tostring(success))
+ *     end)
+ *
+ * Inherits all methods from: none
+ */
+namespace LuaTransaction
+{
+    template<typename T>
+    static void CommitQueries(lua_State* L, DatabaseWorkerPool<T>& db, const std::vector<std::string>& queries, int callbackIdx)
+    {
+        SQLTransaction<T> trans = db.BeginTransaction();
+        for (const std::string& query : queries)
+            trans->Append(query.c_str());
+
+        if (lua_isnoneornil(L, callbackIdx))
+        {
+            db.CommitTransaction(trans);
+            return;
+        }
+
+        lua_pushvalue(L, callbackIdx);
+        int funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (funcRef == LUA_REFNIL || funcRef == LUA_NOREF)
+        {
+            luaL_argerror(L, callbackIdx, "unable to make a ref to function");
+            return;
+        }
+
+        TransactionCallback callback = db.AsyncCommitTransaction(trans);
+        callback.AfterComplete([L, funcRef](bool success)
+            {
+                // Looked up when called, an async reload moves the Lua state and its callbacks to another Eluna
+                Eluna* E = Eluna::GetEluna(L);
+                Eluna::Guard guard(E->GetStateLock());
+
+                // Get function
+                lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+
+                // Push parameters
+                Eluna::Push(L, success);
+
+                // Call function
+                E->ExecuteCall(1, 0);
+
+                luaL_unref(L, LUA_REGISTRYINDEX, funcRef);
+            });
+        Eluna::GetEluna(L)->queryProcessor.AddCallback(std::move(callback));
+    }
+
+    // Commits the queries and empties the transaction, the callback at callbackIdx is optional
+    static bool CommitTransaction(lua_State* L, ElunaTransaction& trans, int callbackIdx)
+    {
+        if (!lua_isnoneornil(L, callbackIdx))
+            luaL_checktype(L, callbackIdx, LUA_TFUNCTION);
+
+        std::vector<std::string> queries = trans.TakeQueries();
+        if (queries.empty())
+            return false;
+
+        switch (trans.GetDatabase())
+        {
+            case ElunaStatement::DATABASE_WORLD:
+                CommitQueries(L, WorldDatabase, queries, callbackIdx);
+                break;
+            case ElunaStatement::DATABASE_CHARACTER:
+                CommitQueries(L, CharacterDatabase, queries, callbackIdx);
+                break;
+            case ElunaStatement::DATABASE_LOGIN:
+                CommitQueries(L, LoginDatabase, queries, callbackIdx);
+                break;
+        }
+        return true;
+    }
+
+    /**
+     * Returns the number of queries appended to the transaction.
+     *
+     * @return uint32 size
+     */
+    int GetSize(lua_State* L, ElunaTransaction* trans)
+    {
+        Eluna::Push(L, trans->GetSize());
+        return 1;
+    }
+
+    /**
+     * Appends a query to the transaction.
+     *
+     * The query can be SQL text with `?` placeholders followed by their values, like
+     *   [Global:CharDBExecute], or an [ElunaStatement] with its current parameters.
+     * An [ElunaBulkInsert] appends the statements for its rows and is left empty.
+     * Statements and builders must be for the same database as the transaction.
+     *
+     * @proto (sql, ...)
+     * @proto (statement)
+     * @proto (bulkInsert)
+     * @param string sql : query to append
+     * @param [ElunaStatement] statement : statement to append
+     * @param [ElunaBulkInsert] bulkInsert : rows to append
+     */
+    int Append(lua_State* L, ElunaTransaction* trans)
+    {
+        if (ElunaStatement* stmt = Eluna::CHECKOBJ<ElunaStatement>(L, 2, false))
+        {
+            if (stmt->GetDatabase() != trans->GetDatabase())
+                return luaL_argerror(L, 2, "statement is for a different database");
+
+            std::string sql;
+            uint32 missing = 0;
+            if (!stmt->Build(sql, missing))
+                return luaL_error(L, "statement parameter %d has no value", int(missing));
+
+            trans->Append(std::move(sql));
+            return 0;
+        }
+
+        if (ElunaBulkInsert* bulk = Eluna::CHECKOBJ<ElunaBulkInsert>(L, 2, false))
+        {
+            if (bulk->GetDatabase() != trans->GetDatabase())
+                return luaL_argerror(L, 2, "bulk insert is for a different database");
+
+            bulk->Flush(*trans);
+            return 0;
+        }
+
+        std::string query = Eluna::CHECKVAL<std::string>(L, 2);
+        if (lua_gettop(L) > 2)
+            query = Eluna::FormatQuery(L, query.c_str(), 3);
+
+        trans->Append(std::move(query));
+        return 0;
+    }
+
+    /**
+     * Removes all queries from the transaction.
+     */
+    int Clear(lua_State* /*L*/, ElunaTransaction* trans)
+    {
+        trans->Clear();
+        return 0;
+    }
+
+    /**
+     * Commits the queries of the transaction, which is left empty to be filled again.
+     *
+     * The transaction is executed asynchronously. If a callback is passed, it is called
+     *   with `true` once the transaction was applied or `false` if it failed and was rolled back.
+     *
+     * @param function callback = nil : function called when the transaction has finished
+     * @return bool committed : `false` if the transaction was empty, the callback is not called then
+     */
+    int Commit(lua_State* L, ElunaTransaction* trans)
+    {
+        Eluna::Push(L, CommitTransaction(L, *trans, 2));
+        return 1;
+    }
+}
+
+#endif
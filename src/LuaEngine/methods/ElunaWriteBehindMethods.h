@@ -0,0 +1,160 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef WRITEBEHINDMETHODS_H
+#define WRITEBEHINDMETHODS_H
+
+#include "ElunaWriteBehind.h"
+
+/***
+ * Buffered writes to one table, only the latest value of each column of a row is written.
+ *
+ * Values are written together every `Eluna.WriteBehindInterval` milliseconds, when a player
+ *   logs out and on shutdown, with INSERT ... ON DUPLICATE KEY UPDATE statements.
+ *   The key columns must be the primary key or a unique key of the table, and the
+ *   other columns need a default value if a row may not exist yet.
+ *
+ * The buffered rows belong to the server, not to the Lua state. They are kept
+ *   across reloads and every state gets the same rows for the same table.
+ *
+ * E.g. the return value of [Global:CharDBWriteBehind].
+ *
+ *     local kills = CharDBWriteBehind("my_kills", { "guid" })
+ *
+ *     local function OnKill(event, killer, killed)
+ *         local guid = killer:GetGUIDLow()
+ *         killCount[guid] = (killCount[guid] or 0) + 1
+ *         kills:Set(guid, "kills", killCount[guid])
+ *     end
+ *
+ * Inherits all methods from: none
+ */
+namespace LuaWriteBehind
+{
+    /**
+     * Returns the names of the key columns.
+     *
+     * @return table keyColumns
+     */
+    int GetKeyColumns(lua_State* L, ElunaWriteBehind* writeBehind)
+    {
+        const std::vector<std::string>& columns = writeBehind->GetTable()->GetKeyColumns();
+        lua_createtable(L, int(columns.size()), 0);
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            Eluna::Push(L, columns[i]);
+            lua_rawseti(L, -2, int(i + 1));
+        }
+        return 1;
+    }
+
+    /**
+     * Returns the number of rows waiting to be written.
+     *
+     * @return uint32 dirtyCount
+     */
+    int GetDirtyCount(lua_State* L, ElunaWriteBehind* writeBehind)
+    {
+        Eluna::Push(L, writeBehind->GetTable()->GetDirtyCount());
+        return 1;
+    }
+
+    /**
+     * Sets columns of the row with the given key, replacing values that were not written yet.
+     *
+     * The key is the value of the key column, or a table with the values of all key columns
+     *   in their order. Use the same Lua type for a key every time, `1` and `"1"` are different keys.
+     * Numbers, strings and booleans are written as SQL values and `nil` as `NULL`.
+     *
+     *     gold:Set(guid, "amount", 100)
+     *     stats:Set({ guid, statId }, { value = 5, updated = os.time() })
+     *
+     * @proto (key, column, value)
+     * @proto (key, values)
+     * @param key : value of the key column or a table of key values
+     * @param string column : name of the column to set
+     * @param value : new value of the column
+     * @param table values : table of column names to their new values
+     */
+    int Set(lua_State* L, ElunaWriteBehind* writeBehind)
+    {
+        ElunaWriteBehindTable* table = writeBehind->GetTable();
+        uint32 keyCount = uint32(table->GetKeyColumns().size());
+
+        std::vector<std::string> key(keyCount);
+        if (lua_istable(L, 2))
+        {
+            if (lua_rawlen(L, 2) != keyCount)
+                return luaL_argerror(L, 2, "wrong number of key values");
+
+            for (uint32 i = 0; i < keyCount; ++i)
+            {
+                lua_rawgeti(L, 2, int(i + 1));
+                if (lua_isnil(L, -1) || !LuaBulkInsert::FormatValue(L, -1, key[i]))
+                    return luaL_argerror(L, 2, "key values must be numbers, strings or booleans");
+                lua_pop(L, 1);
+            }
+        }
+        else if (keyCount != 1)
+            return luaL_argerror(L, 2, "table of key values expected");
+        else if (lua_isnil(L, 2) || !LuaBulkInsert::FormatValue(L, 2, key[0]))
+            return luaL_argerror(L, 2, "number, string, boolean or table expected");
+
+        std::vector<std::pair<std::string, std::string>> values;
+        if (lua_istable(L, 3))
+        {
+            lua_pushnil(L);
+            while (lua_next(L, 3))
+            {
+                if (lua_type(L, -2) != LUA_TSTRING)
+                    return luaL_argerror(L, 3, "column names must be strings");
+
+                std::string column = lua_tostring(L, -2);
+                if (table->IsKeyColumn(column))
+                    return luaL_argerror(L, 3, "key columns can't be set");
+
+                std::string literal;
+                if (!LuaBulkInsert::FormatValue(L, -1, literal))
+                    return luaL_argerror(L, 3, "values must be numbers, strings or booleans");
+
+                values.emplace_back(std::move(column), std::move(literal));
+                lua_pop(L, 1);
+            }
+        }
+        else
+        {
+            std::string column = Eluna::CHECKVAL<std::string>(L, 3);
+            if (table->IsKeyColumn(column))
+                return luaL_argerror(L, 3, "key columns can't be set");
+
+            std::string literal;
+            if (!LuaBulkInsert::FormatValue(L, 4, literal))
+                return luaL_argerror(L, 4, "number, string, boolean or nil expected");
+
+            values.emplace_back(std::move(column), std::move(literal));
+        }
+
+        if (values.empty())
+            return luaL_argerror(L, 3, "no columns to set");
+
+        table->Set(std::move(key), std::move(values));
+        return 0;
+    }
+
+    /**
+     * Writes the waiting rows now instead of at the next interval.
+     *
+     * The rows are written asynchronously. If a previous write of the table is still
+     *   running, they are written right after it has finished.
+     */
+    int Flush(lua_State* /*L*/, ElunaWriteBehind* writeBehind)
+    {
+        writeBehind->GetTable()->Flush();
+        return 0;
+    }
+}
+
+#endif
@@ -9,6 +9,11 @@
 
 #include "BindingMap.h"
 #include "ElunaDBCRegistry.h"
+#include "ElunaQuery.h"
+#include "ElunaQueryMethods.h"
+#include "ElunaStatement.h"
+#include "ElunaTransaction.h"
+#include "ElunaWriteBehind.h"
 
 #include "BanMgr.h"
 #include "GameTime.h"
@@ -147,8 +152,7 @@ namespace LuaGlobalFunctions
      */
     int GetStateMap(lua_State* L)
     {
-        // Until AC supports multistate, this will always return nil
-        Eluna::Push(L);
+        Eluna::Push(L, Eluna::GetEluna(L)->GetBoundMap());
         return 1;
     }
 
@@ -159,8 +163,7 @@ namespace LuaGlobalFunctions
      */
     int GetStateMapId(lua_State* L)
     {
-        // Until AC supports multistate, this will always return -1
-        Eluna::Push(L, -1);
+        Eluna::Push(L, Eluna::GetEluna(L)->GetBoundMapId());
         return 1;
     }
 
@@ -171,8 +174,7 @@ namespace LuaGlobalFunctions
      */
     int GetStateInstanceId(lua_State* L)
     {
-        // Until AC supports multistate, this will always return 0
-        Eluna::Push(L, 0);
+        Eluna::Push(L, Eluna::GetEluna(L)->GetBoundInstanceId());
         return 1;
     }
 
@@ -1403,23 +1405,24 @@ namespace LuaGlobalFunctions
     }
 
     template <typename T>
-    static int DBQueryAsync(lua_State* L, DatabaseWorkerPool<T>& db)
+    static int DBQueryAsync(lua_State* L, DatabaseWorkerPool<T>& db, const std::string& query, int callbackIdx)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
-        luaL_checktype(L, 2, LUA_TFUNCTION);
-        lua_pushvalue(L, 2);
+        luaL_checktype(L, callbackIdx, LUA_TFUNCTION);
+        lua_pushvalue(L, callbackIdx);
         int funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
         if (funcRef == LUA_REFNIL || funcRef == LUA_NOREF)
         {
-            luaL_argerror(L, 2, "unable to make a ref to function");
+            luaL_argerror(L, callbackIdx, "unable to make a ref to function");
             return 0;
         }
 
-        Eluna::GEluna->queryProcessor.AddCallback(db.AsyncQuery(query).WithCallback([L, funcRef](QueryResult result)
+        Eluna::GetEluna(L)->queryProcessor.AddCallback(db.AsyncQuery(query).WithCallback([L, funcRef](QueryResult result)
             {
                 ElunaQuery* eq = result ? new ElunaQuery(result) : nullptr;
 
-                LOCK_ELUNA;
+                // Looked up when called, an async reload moves the Lua state and its callbacks to another Eluna
+                Eluna* E = Eluna::GetEluna(L);
+                Eluna::Guard guard(E->GetStateLock());
 
                 // Get function
                 lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
@@ -1428,7 +1431,7 @@ namespace LuaGlobalFunctions
                 Eluna::Push(L, eq);
 
                 // Call function
-                Eluna::GEluna->ExecuteCall(1, 0);
+                E->ExecuteCall(1, 0);
 
                 luaL_unref(L, LUA_REGISTRYINDEX, funcRef);
             }));
@@ -1436,6 +1439,13 @@ namespace LuaGlobalFunctions
         return 0;
     }
 
+    template <typename T>
+    static int DBQueryAsync(lua_State* L, DatabaseWorkerPool<T>& db)
+    {
+        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        return DBQueryAsync(L, db, query, 2);
+    }
+
     /**
      * Executes a SQL query on the world database and returns an [ElunaQuery].
      *
@@ -1456,13 +1466,13 @@ namespace LuaGlobalFunctions
      */
     int WorldDBQuery(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
 
-        ElunaQuery result = WorldDatabase.Query(query);
+        QueryResult result = WorldDatabase.Query(query);
         if (result)
             Eluna::Push(L, new ElunaQuery(result));
         else
@@ -1509,11 +1519,11 @@ namespace LuaGlobalFunctions
      */
     int WorldDBExecute(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
 
         WorldDatabase.Execute(query);
         return 0;
@@ -1533,15 +1543,15 @@ namespace LuaGlobalFunctions
      */
     int CharDBQuery(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
 
         QueryResult result = CharacterDatabase.Query(query);
         if (result)
-            Eluna::Push(L, new QueryResult(result));
+            Eluna::Push(L, new ElunaQuery(result));
         else
             Eluna::Push(L);
         return 1;
@@ -1579,11 +1589,11 @@ namespace LuaGlobalFunctions
      */
     int CharDBExecute(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
 
         CharacterDatabase.Execute(query);
         return 0;
@@ -1603,20 +1613,281 @@ namespace LuaGlobalFunctions
      */
     int AuthDBQuery(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
 
         QueryResult result = LoginDatabase.Query(query);
         if (result)
-            Eluna::Push(L, new QueryResult(result));
+            Eluna::Push(L, new ElunaQuery(result));
         else
             Eluna::Push(L);
         return 1;
     }
 
+    template <typename T>
+    static int DBQueryCached(lua_State* L, DatabaseWorkerPool<T>& db, ElunaStatement::DatabaseType database)
+    {
+        uint32 ttl = ElunaConfig::GetInstance().GetQueryCacheTTL();
+        std::vector<std::string> tags;
+        if (lua_istable(L, 1))
+        {
+            lua_getfield(L, 1, "ttl");
+            if (!lua_isnil(L, -1))
+                ttl = Eluna::CHECKVAL<uint32>(L, -1);
+            lua_pop(L, 1);
+
+            lua_getfield(L, 1, "tags");
+            if (lua_istable(L, -1))
+            {
+                for (int i = 1; ; ++i)
+                {
+                    lua_rawgeti(L, -1, i);
+                    if (lua_isnil(L, -1))
+                    {
+                        lua_pop(L, 1);
+                        break;
+                    }
+                    tags.push_back(Eluna::CHECKVAL<std::string>(L, -1));
+                    lua_pop(L, 1);
+                }
+            }
+            else if (!lua_isnil(L, -1))
+                tags.push_back(Eluna::CHECKVAL<std::string>(L, -1));
+            lua_pop(L, 1);
+        }
+        else if (!lua_isnil(L, 1))
+            tags.push_back(Eluna::CHECKVAL<std::string>(L, 1));
+
+        std::string query = Eluna::CHECKVAL<std::string>(L, 2);
+        if (lua_gettop(L) > 2)
+            query = Eluna::FormatQuery(L, query.c_str(), 3);
+
+        // Without a cache the result is read from the core result set as usual
+        if (!ElunaConfig::GetInstance().GetQueryCacheSize())
+        {
+            QueryResult result = db.Query(query);
+            if (result)
+                Eluna::Push(L, new ElunaQuery(result));
+            else
+                Eluna::Push(L);
+            return 1;
+        }
+
+        ElunaQueryCache& cache = ElunaQueryCache::GetInstance();
+        std::shared_ptr<const ElunaQueryData> data = cache.Get(database, query);
+        if (!data)
+        {
+            data = std::make_shared<const ElunaQueryData>(db.Query(query));
+            cache.Store(database, query, data, ttl, tags);
+        }
+
+        if (data->rowCount)
+            Eluna::Push(L, new ElunaQuery(data));
+        else
+            Eluna::Push(L);
+        return 1;
+    }
+
+    /**
+     * Executes a SQL query on the world database and returns an [ElunaQuery], or a cached copy of its result.
+     *
+     * Results are cached by their query text, including the values of the `?` placeholders, and
+     *   are shared by all Lua states. A cached result is returned without contacting the database
+     *   until its TTL has passed or one of its tags is invalidated, see [Global:InvalidateQueryCache].
+     * Queries without rows are cached as well and return `nil`.
+     *
+     * The options are a tag, or a table with an optional `ttl` in seconds and `tags`, a tag or an array of tags.
+     *   Without a `ttl` the result is kept for `Eluna.QueryCacheTTL` seconds.
+     *
+     *     local function GetVendorItems(entry)
+     *         return WorldDBQueryCached("vendors", "SELECT item FROM npc_vendor WHERE entry = ?", entry)
+     *     end
+     *
+     *     local top = CharDBQueryCached({ ttl = 30, tags = { "leaderboard" } }, "SELECT name, kills FROM my_kills ORDER BY kills DESC LIMIT 10")
+     *
+     * @param options : tag or table of options, can be nil
+     * @param string sql : query to execute
+     * @param ... : values for the `?` placeholders of the query
+     * @return [ElunaQuery] results or nil if no rows found
+     */
+    int WorldDBQueryCached(lua_State* L)
+    {
+        return DBQueryCached(L, WorldDatabase, ElunaStatement::DATABASE_WORLD);
+    }
+
+    /**
+     * Executes a SQL query on the character database and returns an [ElunaQuery], or a cached copy of its result.
+     *
+     * For details and an example see [Global:WorldDBQueryCached].
+     *
+     * @param options : tag or table of options, can be nil
+     * @param string sql : query to execute
+     * @param ... : values for the `?` placeholders of the query
+     * @return [ElunaQuery] results or nil if no rows found
+     */
+    int CharDBQueryCached(lua_State* L)
+    {
+        return DBQueryCached(L, CharacterDatabase, ElunaStatement::DATABASE_CHARACTER);
+    }
+
+    /**
+     * Executes a SQL query on the login database and returns an [ElunaQuery], or a cached copy of its result.
+     *
+     * For details and an example see [Global:WorldDBQueryCached].
+     *
+     * @param options : tag or table of options, can be nil
+     * @param string sql : query to execute
+     * @param ... : values for the `?` placeholders of the query
+     * @return [ElunaQuery] results or nil if no rows found
+     */
+    int AuthDBQueryCached(lua_State* L)
+    {
+        return DBQueryCached(L, LoginDatabase, ElunaStatement::DATABASE_LOGIN);
+    }
+
+    /**
+     * Removes cached query results, so the next call of the query runs it again.
+     *
+     * With a tag only the results cached with that tag are removed, otherwise all of them.
+     *
+     *     CharDBExecute("UPDATE my_kills SET kills = kills + 1 WHERE guid = ?", guid)
+     *     InvalidateQueryCache("leaderboard")
+     *
+     * @param string tag = nil : tag given to [Global:WorldDBQueryCached] and the other cached query functions
+     * @return uint32 removed : number of results removed
+     */
+    int InvalidateQueryCache(lua_State* L)
+    {
+        ElunaQueryCache& cache = ElunaQueryCache::GetInstance();
+        if (lua_isnoneornil(L, 1))
+            Eluna::Push(L, cache.Clear());
+        else
+            Eluna::Push(L, cache.Invalidate(Eluna::CHECKVAL<std::string>(L, 1)));
+        return 1;
+    }
+
+    template <typename T>
+    static int DBQueryStream(lua_State* L, DatabaseWorkerPool<T>& db)
+    {
+        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        uint32 chunkSize = Eluna::CHECKVAL<uint32>(L, 2);
+        if (!chunkSize)
+            return luaL_argerror(L, 2, "chunkSize must be greater than 0");
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+        if (!lua_isnoneornil(L, 4))
+            luaL_checktype(L, 4, LUA_TFUNCTION);
+
+        lua_pushvalue(L, 3);
+        int chunkRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        int doneRef = LUA_NOREF;
+        if (!lua_isnoneornil(L, 4))
+        {
+            lua_pushvalue(L, 4);
+            doneRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+
+        Eluna::GetEluna(L)->queryProcessor.AddCallback(db.AsyncQuery(query).WithCallback([L, chunkRef, doneRef, chunkSize](QueryResult result)
+            {
+                // The rows are converted a chunk per update, the result is kept until the last one
+                std::shared_ptr<ElunaQuery> cursor = result ? std::make_shared<ElunaQuery>(result) : nullptr;
+                uint32 total = 0;
+                Eluna::GetEluna(L)->queryProcessor.AddStream([L, cursor, chunkRef, doneRef, chunkSize, total]() mutable
+                    {
+                        Eluna* E = Eluna::GetEluna(L);
+                        Eluna::Guard guard(E->GetStateLock());
+
+                        if (cursor && cursor->HasRow())
+                        {
+                            lua_rawgeti(L, LUA_REGISTRYINDEX, chunkRef);
+                            total += LuaQuery::PushRows(L, cursor.get(), chunkSize);
+
+                            // Stops early on errors and when the callback returns false
+                            bool stop = !E->ExecuteCall(1, 1) || (lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+                            lua_pop(L, 1);
+                            if (!stop && cursor->HasRow())
+                                return false;
+                        }
+
+                        luaL_unref(L, LUA_REGISTRYINDEX, chunkRef);
+                        if (doneRef != LUA_NOREF)
+                        {
+                            lua_rawgeti(L, LUA_REGISTRYINDEX, doneRef);
+                            Eluna::Push(L, total);
+                            E->ExecuteCall(1, 0);
+                            luaL_unref(L, LUA_REGISTRYINDEX, doneRef);
+                        }
+                        return true;
+                    });
+            }));
+
+        return 0;
+    }
+
+    /**
+     * Executes an asynchronous SQL query on the world database and passes its rows to a callback function in chunks, one chunk per server update.
+     *
+     * Each chunk is an array of at most `chunkSize` rows, converted like [ElunaQuery:GetRows] does.
+     *   Only one chunk is converted per update, so loading a large table does not stall the server
+     *   for one long update like reading the whole result of [Global:WorldDBQueryAsync] would.
+     *   The chunks share the `Eluna.UpdateBudget` with the other callbacks.
+     *
+     * The chunk callback can return `false` to skip the remaining rows, and errors in it do the same.
+     *   The completion callback is called with the number of rows passed to the chunk callback, also when
+     *   the query had no rows or failed. The database still returns the whole result at once, only the
+     *   conversion to Lua is spread.
+     *
+     *     local items = {}
+     *     WorldDBQueryStream("SELECT entry, name FROM item_template", 500, function(rows)
+     *         for _, row in ipairs(rows) do
+     *             items[row.entry] = row.name
+     *         end
+     *     end, function(count)
+     *         print("loaded " .. count .. " items")
+     *     end)
+     *
+     * @param string sql : query to execute
+     * @param uint32 chunkSize : most rows passed to the chunk callback at a time
+     * @param function onChunk : function called with an array of rows, until all rows are read
+     * @param function onDone = nil : function called with the row count after the last chunk
+     */
+    int WorldDBQueryStream(lua_State* L)
+    {
+        return DBQueryStream(L, WorldDatabase);
+    }
+
+    /**
+     * Executes an asynchronous SQL query on the character database and passes its rows to a callback function in chunks, one chunk per server update.
+     *
+     * For details and an example see [Global:WorldDBQueryStream].
+     *
+     * @param string sql : query to execute
+     * @param uint32 chunkSize : most rows passed to the chunk callback at a time
+     * @param function onChunk : function called with an array of rows, until all rows are read
+     * @param function onDone = nil : function called with the row count after the last chunk
+     */
+    int CharDBQueryStream(lua_State* L)
+    {
+        return DBQueryStream(L, CharacterDatabase);
+    }
+
+    /**
+     * Executes an asynchronous SQL query on the login database and passes its rows to a callback function in chunks, one chunk per server update.
+     *
+     * For details and an example see [Global:WorldDBQueryStream].
+     *
+     * @param string sql : query to execute
+     * @param uint32 chunkSize : most rows passed to the chunk callback at a time
+     * @param function onChunk : function called with an array of rows, until all rows are read
+     * @param function onDone = nil : function called with the row count after the last chunk
+     */
+    int AuthDBQueryStream(lua_State* L)
+    {
+        return DBQueryStream(L, LoginDatabase);
+    }
+
     /**
      * Executes an asynchronous SQL query on the character database and passes an [ElunaQuery] to a callback function.
      *
@@ -1649,16 +1920,237 @@ namespace LuaGlobalFunctions
      */
     int AuthDBExecute(lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
 
         int numArgs = lua_gettop(L);
         if (numArgs > 1)
-            query = Eluna::FormatQuery(L, query).c_str();
+            query = Eluna::FormatQuery(L, query.c_str());
             
         LoginDatabase.Execute(query);
         return 0;
     }
 
+    /**
+     * Declares a statement on the world database and returns an [ElunaStatement].
+     *
+     * The query is split at its `?` placeholders once, so a statement declared when the script
+     *   loads can be run many times by only setting its parameters.
+     *
+     *     local getName = WorldDBPrepare("SELECT name FROM creature_template WHERE entry = ?")
+     *     getName:SetUInt32(0, 6)
+     *     local Q = getName:Query()
+     *
+     * @param string sql : query with `?` placeholders for the parameters
+     * @return [ElunaStatement] statement
+     */
+    int WorldDBPrepare(lua_State* L)
+    {
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
+        Eluna::Push(L, new ElunaStatement(ElunaStatement::DATABASE_WORLD, query));
+        return 1;
+    }
+
+    /**
+     * Declares a statement on the character database and returns an [ElunaStatement].
+     *
+     * For an example see [Global:WorldDBPrepare].
+     *
+     * @param string sql : query with `?` placeholders for the parameters
+     * @return [ElunaStatement] statement
+     */
+    int CharDBPrepare(lua_State* L)
+    {
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
+        Eluna::Push(L, new ElunaStatement(ElunaStatement::DATABASE_CHARACTER, query));
+        return 1;
+    }
+
+    /**
+     * Declares a statement on the login database and returns an [ElunaStatement].
+     *
+     * For an example see [Global:WorldDBPrepare].
+     *
+     * @param string sql : query with `?` placeholders for the parameters
+     * @return [ElunaStatement] statement
+     */
+    int AuthDBPrepare(lua_State* L)
+    {
+        std::string query = Eluna::CHECKVAL<std::string>(L, 1);
+        Eluna::Push(L, new ElunaStatement(ElunaStatement::DATABASE_LOGIN, query));
+        return 1;
+    }
+
+    /**
+     * Starts a transaction on the world database and returns an [ElunaTransaction].
+     *
+     * Nothing is sent to the database until [ElunaTransaction:Commit] is called.
+     *
+     * @return [ElunaTransaction] transaction
+     */
+    int WorldDBBeginTransaction(lua_State* L)
+    {
+        Eluna::Push(L, new ElunaTransaction(ElunaStatement::DATABASE_WORLD));
+        return 1;
+    }
+
+    /**
+     * Starts a transaction on the character database and returns an [ElunaTransaction].
+     *
+     * Nothing is sent to the database until [ElunaTransaction:Commit] is called.
+     *
+     * @return [ElunaTransaction] transaction
+     */
+    int CharDBBeginTransaction(lua_State* L)
+    {
+        Eluna::Push(L, new ElunaTransaction(ElunaStatement::DATABASE_CHARACTER));
+        return 1;
+    }
+
+    /**
+     * Starts a transaction on the login database and returns an [ElunaTransaction].
+     *
+     * Nothing is sent to the database until [ElunaTransaction:Commit] is called.
+     *
+     * @return [ElunaTransaction] transaction
+     */
+    int AuthDBBeginTransaction(lua_State* L)
+    {
+        Eluna::Push(L, new ElunaTransaction(ElunaStatement::DATABASE_LOGIN));
+        return 1;
+    }
+
+    static std::vector<std::string> CheckColumnNames(lua_State* L, int index)
+    {
+        luaL_checktype(L, index, LUA_TTABLE);
+
+        std::vector<std::string> columns;
+        for (int i = 1; ; ++i)
+        {
+            lua_rawgeti(L, index, i);
+            if (lua_isnil(L, -1))
+            {
+                lua_pop(L, 1);
+                break;
+            }
+            columns.push_back(Eluna::CHECKVAL<std::string>(L, -1));
+            lua_pop(L, 1);
+        }
+
+        if (columns.empty())
+            luaL_argerror(L, index, "at least one column expected");
+        return columns;
+    }
+
+    static int DBBulkInsert(lua_State* L, ElunaStatement::DatabaseType database)
+    {
+        std::string table = Eluna::CHECKVAL<std::string>(L, 1);
+        std::vector<std::string> columns = CheckColumnNames(L, 2);
+        uint32 rowsPerStatement = Eluna::CHECKVAL<uint32>(L, 3, 500);
+
+        Eluna::Push(L, new ElunaBulkInsert(database, table, columns, rowsPerStatement));
+        return 1;
+    }
+
+    /**
+     * Returns an [ElunaBulkInsert] that inserts rows into a world database table with multi-row INSERT statements.
+     *
+     * For an example see [ElunaBulkInsert].
+     *
+     * @param string table : name of the table
+     * @param table columns : names of the columns each row has values for
+     * @param uint32 rowsPerStatement = 500 : most rows sent in one INSERT statement
+     * @return [ElunaBulkInsert] bulkInsert
+     */
+    int WorldDBBulkInsert(lua_State* L)
+    {
+        return DBBulkInsert(L, ElunaStatement::DATABASE_WORLD);
+    }
+
+    /**
+     * Returns an [ElunaBulkInsert] that inserts rows into a character database table with multi-row INSERT statements.
+     *
+     * For an example see [ElunaBulkInsert].
+     *
+     * @param string table : name of the table
+     * @param table columns : names of the columns each row has values for
+     * @param uint32 rowsPerStatement = 500 : most rows sent in one INSERT statement
+     * @return [ElunaBulkInsert] bulkInsert
+     */
+    int CharDBBulkInsert(lua_State* L)
+    {
+        return DBBulkInsert(L, ElunaStatement::DATABASE_CHARACTER);
+    }
+
+    /**
+     * Returns an [ElunaBulkInsert] that inserts rows into a login database table with multi-row INSERT statements.
+     *
+     * For an example see [ElunaBulkInsert].
+     *
+     * @param string table : name of the table
+     * @param table columns : names of the columns each row has values for
+     * @param uint32 rowsPerStatement = 500 : most rows sent in one INSERT statement
+     * @return [ElunaBulkInsert] bulkInsert
+     */
+    int AuthDBBulkInsert(lua_State* L)
+    {
+        return DBBulkInsert(L, ElunaStatement::DATABASE_LOGIN);
+    }
+
+    static int DBWriteBehind(lua_State* L, ElunaStatement::DatabaseType database)
+    {
+        std::string name = Eluna::CHECKVAL<std::string>(L, 1);
+        std::vector<std::string> keyColumns = CheckColumnNames(L, 2);
+
+        ElunaWriteBehindTable* table = ElunaWriteBehindMgr::GetInstance().GetTable(database, name, keyColumns);
+        if (!table)
+            return luaL_argerror(L, 2, "the table is already buffered with other key columns");
+
+        Eluna::Push(L, new ElunaWriteBehind(table));
+        return 1;
+    }
+
+    /**
+     * Returns an [ElunaWriteBehind] that buffers writes to a world database table and writes only the latest values.
+     *
+     * Every call with the same table returns the same buffered rows. For an example see [ElunaWriteBehind].
+     *
+     * @param string table : name of the table
+     * @param table keyColumns : names of the columns of the primary or a unique key
+     * @return [ElunaWriteBehind] writeBehind
+     */
+    int WorldDBWriteBehind(lua_State* L)
+    {
+        return DBWriteBehind(L, ElunaStatement::DATABASE_WORLD);
+    }
+
+    /**
+     * Returns an [ElunaWriteBehind] that buffers writes to a character database table and writes only the latest values.
+     *
+     * Every call with the same table returns the same buffered rows. For an example see [ElunaWriteBehind].
+     *
+     * @param string table : name of the table
+     * @param table keyColumns : names of the columns of the primary or a unique key
+     * @return [ElunaWriteBehind] writeBehind
+     */
+    int CharDBWriteBehind(lua_State* L)
+    {
+        return DBWriteBehind(L, ElunaStatement::DATABASE_CHARACTER);
+    }
+
+    /**
+     * Returns an [ElunaWriteBehind] that buffers writes to a login database table and writes only the latest values.
+     *
+     * Every call with the same table returns the same buffered rows. For an example see [ElunaWriteBehind].
+     *
+     * @param string table : name of the table
+     * @param table keyColumns : names of the columns of the primary or a unique key
+     * @return [ElunaWriteBehind] writeBehind
+     */
+    int AuthDBWriteBehind(lua_State* L)
+    {
+        return DBWriteBehind(L, ElunaStatement::DATABASE_LOGIN);
+    }
+
     /**
      * Registers a global timed event.
      *
@@ -1702,22 +2194,27 @@ namespace LuaGlobalFunctions
         int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
         if (functionRef != LUA_REFNIL && functionRef != LUA_NOREF)
         {
-            Eluna::GetEluna(L)->eventMgr->globalProcessor->AddEvent(functionRef, min, max, repeats);
+            Eluna* E = Eluna::GetEluna(L);
+            E->eventMgr->globalProcessor->AddEvent(functionRef, min, max, repeats);
+            E->scriptModules.AddEvent(L, functionRef);
             Eluna::Push(L, functionRef);
         }
         return 1;
     }
 
     /**
-     * Removes a global timed event specified by ID.
+     * Removes a timed event specified by ID.
+     *
+     * Event IDs are unique, so by default the event is found whether it is global or
+     *   was registered on an object. Pass `false` to only look at global events.
      *
      * @param int eventId : event Id to remove
-     * @param bool all_Events = false : remove from all events, not just global
+     * @param bool all_Events = true : remove from all events, not just global
      */
     int RemoveEventById(lua_State* L)
     {
         int eventId = Eluna::CHECKVAL<int>(L, 1);
-        bool all_Events = Eluna::CHECKVAL<bool>(L, 1, false);
+        bool all_Events = Eluna::CHECKVAL<bool>(L, 2, true);
 
         // not thread safe
         if (all_Events)
@@ -2599,6 +3096,20 @@ namespace LuaGlobalFunctions
      * Performs a non-blocking HTTP request.
      *
      * When the passed callback function is called, the parameters `(status, body, headers)` are passed to it.
+     * If the request fails without a response, the status is `0`.
+     *
+     * The optional mode decides how the response is handed to the callback:
+     *
+     * <pre>
+     * enum HttpResponseMode
+     * {
+     *     HTTP_RESPONSE_STRINGS = 0, // (status, body, headers) with the body as a string and the headers as a table
+     *     HTTP_RESPONSE_LAZY    = 1, // (status, response) with an [HttpResponse], the body and headers are only copied into Lua when asked for
+     *     HTTP_RESPONSE_STREAM  = 2  // (status, response, last) once for every chunk of the body of a GET as it arrives, `last` is `true` for the final call
+     * };
+     * </pre>
+     *
+     * With `Eluna.HttpCache` enabled, GET requests may be answered from the response cache or share the response of an identical request.
      *
      *     -- GET example (prints a random word)
      *     HttpRequest("GET", "https://random-word-api.herokuapp.com/word", function(status, body, headers)
@@ -2615,10 +3126,22 @@ namespace LuaGlobalFunctions
      *         print(body)
      *     end)
      *
-     * @proto (httpMethod, url, function)
-     * @proto (httpMethod, url, headers, function)
-     * @proto (httpMethod, url, body, contentType, function)
-     * @proto (httpMethod, url, body, contentType, headers, function)
+     *     -- Lazy mode, the body is never copied when only the status is used
+     *     HttpRequest("HEAD", "https://www.azerothcore.org", function(status, response)
+     *         print(status, response:GetHeader("Content-Type"))
+     *     end, 1)
+     *
+     *     -- Stream mode, a large download handed over in chunks
+     *     local size = 0
+     *     HttpRequest("GET", "https://example.com/large.bin", function(status, response, last)
+     *         size = size + response:GetSize()
+     *         if last then print("Downloaded " .. size .. " bytes") end
+     *     end, 2)
+     *
+     * @proto (httpMethod, url, function, mode)
+     * @proto (httpMethod, url, headers, function, mode)
+     * @proto (httpMethod, url, body, contentType, function, mode)
+     * @proto (httpMethod, url, body, contentType, headers, function, mode)
      *
      * @param string httpMethod : the HTTP method to use (possible values are: `"GET"`, `"HEAD"`, `"POST"`, `"PUT"`, `"PATCH"`, `"DELETE"`, `"OPTIONS"`)
      * @param string url : the URL to query
@@ -2626,6 +3149,8 @@ namespace LuaGlobalFunctions
      * @param string body : the request's body (only used for POST, PUT and PATCH requests)
      * @param string contentType : the body's content-type
      * @param function function : function that will be called when the request is executed
+     * @param [HttpResponseMode] mode = 0 : how the response is passed to the function, see above
+     * @return bool queued : `false` if the request queue was full and the request was dropped, see `Eluna.HttpQueueOverflow`
      */
     int HttpRequest(lua_State* L)
     {
@@ -2665,18 +3190,100 @@ namespace LuaGlobalFunctions
             }
         }
 
+        uint8 mode = Eluna::CHECKVAL<uint8>(L, callbackIdx + 1, HTTP_RESPONSE_STRINGS);
+        if (mode > HTTP_RESPONSE_STREAM)
+            return luaL_argerror(L, callbackIdx + 1, "valid HttpResponseMode expected");
+
         lua_pushvalue(L, callbackIdx);
         int funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
         if (funcRef >= 0)
         {
-            Eluna::GEluna->httpManager.PushRequest(new HttpWorkItem(funcRef, httpVerb, url, body, bodyContentType, headers));
+            Eluna::Push(L, Eluna::GetEluna(L)->httpManager.PushRequest(new HttpWorkItem(funcRef, httpVerb, url, body, bodyContentType, headers, mode)));
         }
         else
         {
             luaL_argerror(L, callbackIdx, "unable to make a ref to function");
         }
 
-        return 0;
+        return 1;
+    }
+
+    /**
+     * Returns the counters of the HTTP requests made with [Global:HttpRequest] by this Lua state.
+     *
+     *     local enqueued, queued, inFlight, dropped = GetHttpRequestStats()
+     *
+     * @return uint64 enqueued : requests accepted since the first request
+     * @return uint32 queued : requests waiting for a worker
+     * @return uint32 inFlight : requests being run by a worker right now
+     * @return uint64 dropped : requests dropped because the queue was full
+     */
+    int GetHttpRequestStats(lua_State* L)
+    {
+        HttpManager& httpManager = Eluna::GetEluna(L)->httpManager;
+        Eluna::Push(L, httpManager.GetEnqueuedCount());
+        Eluna::Push(L, httpManager.GetQueuedCount());
+        Eluna::Push(L, httpManager.GetInFlightCount());
+        Eluna::Push(L, httpManager.GetDroppedCount());
+        return 4;
+    }
+
+    /**
+     * Returns the counters of the HTTP response cache of this Lua state, see `Eluna.HttpCache`.
+     *
+     *     local hits, misses, coalesced = GetHttpCacheStats()
+     *
+     * @return uint64 hits : GET requests answered with a fresh cached response
+     * @return uint64 misses : GET requests sent to the server, including revalidations
+     * @return uint64 coalesced : GET requests that waited for an identical request already running
+     */
+    int GetHttpCacheStats(lua_State* L)
+    {
+        HttpManager& httpManager = Eluna::GetEluna(L)->httpManager;
+        Eluna::Push(L, httpManager.GetCacheHitCount());
+        Eluna::Push(L, httpManager.GetCacheMissCount());
+        Eluna::Push(L, httpManager.GetCoalescedCount());
+        return 3;
+    }
+
+    /**
+     * Returns the counters of the query result cache, which is shared by all Lua states, see `Eluna.QueryCacheSize`.
+     *
+     *     local hits, misses, entries, memory = GetQueryCacheStats()
+     *
+     * @return uint64 hits : cached queries answered from the cache
+     * @return uint64 misses : cached queries sent to the database
+     * @return uint32 entries : results in the cache right now
+     * @return uint64 memory : approximate bytes used by the cached results
+     */
+    int GetQueryCacheStats(lua_State* L)
+    {
+        ElunaQueryCache& cache = ElunaQueryCache::GetInstance();
+        Eluna::Push(L, cache.GetHitCount());
+        Eluna::Push(L, cache.GetMissCount());
+        Eluna::Push(L, cache.GetEntryCount());
+        Eluna::Push(L, uint64(cache.GetMemoryUsage()));
+        return 4;
+    }
+
+    /**
+     * Returns the callbacks of this Lua state waiting for a later update.
+     *
+     * With `Eluna.UpdateBudget` set, callbacks that did not fit in the budget of an update are left for the next one.
+     *
+     *     local timers, responses, queries = GetPendingCallbacks()
+     *
+     * @return uint32 timers : global timed events that were due but left for the next update
+     * @return uint32 responses : HTTP responses waiting for their callback
+     * @return uint32 queries : async queries and transactions waiting for their result or callback, and unfinished query streams
+     */
+    int GetPendingCallbacks(lua_State* L)
+    {
+        Eluna* E = Eluna::GetEluna(L);
+        Eluna::Push(L, E->eventMgr->globalProcessor->GetDueCount());
+        Eluna::Push(L, E->httpManager.GetResponseCount());
+        Eluna::Push(L, uint32(E->queryProcessor.GetPendingCount()));
+        return 3;
     }
 
     /**
@@ -0,0 +1,98 @@
+/*
+* Copyright (C) 2010 - 2016 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef HTTPRESPONSEMETHODS_H
+#define HTTPRESPONSEMETHODS_H
+
+#include "HttpManager.h"
+
+/***
+ * The response to a request made with [Global:HttpRequest] in lazy or stream mode.
+ *
+ * The body and headers stay in the response until they are asked for, a callback
+ *   that only checks the status never copies them into Lua.
+ * In stream mode each response holds one chunk of the body.
+ *
+ * Inherits all methods from: none
+ */
+namespace LuaHttpResponse
+{
+    /**
+     * Returns the HTTP status code of the response, 0 if the request was dropped.
+     *
+     * @return int32 status
+     */
+    int GetStatus(lua_State* L, HttpResponse* response)
+    {
+        Eluna::Push(L, response->statusCode);
+        return 1;
+    }
+
+    /**
+     * Returns the body of the response as a string, or the chunk of the body in stream mode.
+     *
+     * @return string text
+     */
+    int GetText(lua_State* L, HttpResponse* response)
+    {
+        lua_pushlstring(L, response->body.data(), response->body.size());
+        return 1;
+    }
+
+    /**
+     * Returns the size of the body of the response in bytes, or the size of the chunk in stream mode.
+     *
+     * @return uint32 size
+     */
+    int GetSize(lua_State* L, HttpResponse* response)
+    {
+        Eluna::Push(L, uint32(response->body.size()));
+        return 1;
+    }
+
+    /**
+     * Returns the value of the response header with the given name, or `nil` if the response has no such header.
+     *
+     * Header names are not case sensitive.
+     *
+     * @param string name
+     * @return string value
+     */
+    int GetHeader(lua_State* L, HttpResponse* response)
+    {
+        std::string name = Eluna::CHECKVAL<std::string>(L, 2);
+
+        httplib::Headers::const_iterator it = response->headers.find(name);
+        if (it == response->headers.end())
+            Eluna::Push(L);
+        else
+            Eluna::Push(L, it->second);
+        return 1;
+    }
+
+    /**
+     * Returns a table with all the headers of the response, names as keys.
+     *
+     * @return table headers
+     */
+    int GetHeaders(lua_State* L, HttpResponse* response)
+    {
+        lua_newtable(L);
+        int tbl = lua_gettop(L);
+
+        for (const auto& header : response->headers)
+        {
+            Eluna::Push(L, header.first);
+            Eluna::Push(L, header.second);
+            lua_settable(L, tbl);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+}
+
+#endif
@@ -765,11 +765,27 @@ namespace LuaWorldObject
         if (min > max)
             return luaL_argerror(L, 3, "min is bigger than max delay");
 
+        // With multistate the object's events belong to the state of its map
+        Eluna* E = Eluna::GetEluna(L);
+        if (Eluna::GetStateFor(obj) != E)
+            return luaL_error(L, "object events can only be registered from the Lua state that owns the object");
+
+        // The processor is only created once the object gets its first event,
+        // a leftover one from a destroyed state is replaced
+        if (obj->elunaEvents && obj->elunaEvents->GetOwner() != E)
+        {
+            delete obj->elunaEvents;
+            obj->elunaEvents = nullptr;
+        }
+        if (!obj->elunaEvents)
+            obj->elunaEvents = new ElunaEventProcessor(E, obj);
+
         lua_pushvalue(L, 2);
         int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
         if (functionRef != LUA_REFNIL && functionRef != LUA_NOREF)
         {
             obj->elunaEvents->AddEvent(functionRef, min, max, repeats);
+            E->scriptModules.AddEvent(L, functionRef);
             Eluna::Push(L, functionRef);
         }
         return 1;
@@ -783,6 +799,10 @@ namespace LuaWorldObject
     int RemoveEventById(lua_State* L, WorldObject* obj)
     {
         int eventId = Eluna::CHECKVAL<int>(L, 2);
+        if (!obj->elunaEvents)
+            return 0;
+        if (obj->elunaEvents->GetOwner() != Eluna::GetEluna(L))
+            return luaL_error(L, "object events can only be removed from the Lua state that owns the object");
         obj->elunaEvents->SetState(eventId, LUAEVENT_STATE_ABORT);
         return 0;
     }
@@ -791,8 +811,12 @@ namespace LuaWorldObject
      * Removes all timed events from a [WorldObject]
      *
      */
-    int RemoveEvents(lua_State* /*L*/, WorldObject* obj)
+    int RemoveEvents(lua_State* L, WorldObject* obj)
     {
+        if (!obj->elunaEvents)
+            return 0;
+        if (obj->elunaEvents->GetOwner() != Eluna::GetEluna(L))
+            return luaL_error(L, "object events can only be removed from the Lua state that owns the object");
         obj->elunaEvents->SetStates(LUAEVENT_STATE_ABORT);
         return 0;
     }